@@ -5,278 +5,4559 @@
 #include <algorithm>
 #include <cctype>
 #include <cmath>
-#include <regex>
+#include <string_view>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <future>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <shared_mutex>
+#include <chrono>
+#include <iomanip>
+#include <filesystem>
+#include <cerrno>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// ============================================================
+//  Allocation counting
+// ============================================================
+
+// build with -DSIMPLIFIER_COUNT_ALLOCS to count every heap allocation in
+// the process. allocationCount() is always there, it just stays at 0
+// without the flag
+
+namespace {
+std::atomic<uint64_t> gAllocs{0};
+} // namespace
+
+uint64_t allocationCount() {
+    return gAllocs.load(std::memory_order_relaxed);
+}
+
+#ifdef SIMPLIFIER_COUNT_ALLOCS
+// kept out of line: once gcc inlines malloc/free into the callers it
+// warns about mismatched new/delete
+#if defined(__GNUC__)
+#define SIMPLIFIER_NOINLINE __attribute__((noinline))
+#else
+#define SIMPLIFIER_NOINLINE
+#endif
+
+SIMPLIFIER_NOINLINE void* operator new(std::size_t n) {
+    gAllocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+
+SIMPLIFIER_NOINLINE void operator delete(void* p) noexcept { std::free(p); }
+SIMPLIFIER_NOINLINE void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+// std::pmr::new_delete_resource goes through the aligned forms
+SIMPLIFIER_NOINLINE void* operator new(std::size_t n, std::align_val_t al) {
+    gAllocs.fetch_add(1, std::memory_order_relaxed);
+    size_t a = (size_t)al;
+    size_t rounded = (std::max<size_t>(n, 1) + a - 1) / a * a;
+#if defined(_WIN32)
+    if (void* p = _aligned_malloc(rounded, a)) return p;
+#else
+    if (void* p = std::aligned_alloc(a, rounded)) return p;
+#endif
+    throw std::bad_alloc();
+}
+
+#if defined(_WIN32)
+SIMPLIFIER_NOINLINE void operator delete(void* p, std::align_val_t) noexcept { _aligned_free(p); }
+SIMPLIFIER_NOINLINE void operator delete(void* p, std::size_t, std::align_val_t) noexcept { _aligned_free(p); }
+#else
+SIMPLIFIER_NOINLINE void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+SIMPLIFIER_NOINLINE void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+#endif
+#endif
+
+// ============================================================
+//  Pipeline stats
+// ============================================================
+
+// off by default. once on, every thread adds to its own block of
+// counters (plain relaxed stores, no shared cache lines) and
+// pipelineStats() sums the blocks. stage timings are sampled one
+// sentence in kStatSample and scaled up, so turning this on costs a few
+// ns per sentence rather than a clock read per stage
+
+struct PipelineStats {
+    uint64_t documents = 0;
+    uint64_t sentences = 0;
+    uint64_t bytesIn = 0, bytesOut = 0;
+    uint64_t wordsReplaced = 0;
+    uint64_t sentencesSplit = 0;    // sentences that came out as more than one
+    // estimated, summed over all threads
+    uint64_t stripNs = 0, swapNs = 0, passiveNs = 0, splitNs = 0, rejoinNs = 0;
+    uint64_t customNs = 0;          // stages added with addStage
+};
+
+namespace {
+
+constexpr uint64_t kStatSample = 8;
+
+enum Stage { kStageStrip, kStageSwap, kStagePassive, kStageCustom, kStageSplit, kStageRejoin, kStageCount };
+
+struct StatBlock {
+    std::atomic<uint64_t> documents{0}, sentences{0}, bytesIn{0}, bytesOut{0};
+    std::atomic<uint64_t> wordsReplaced{0}, sentencesSplit{0};
+    std::atomic<uint64_t> ns[kStageCount] = {};
+    uint64_t tick[kStageCount] = {};  // owner only, picks what gets timed
+};
+
+// only the owning thread writes a live block, so no locked add needed
+void bump(std::atomic<uint64_t>& c, uint64_t v) {
+    c.store(c.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+}
+
+void addInto(PipelineStats& s, const StatBlock& b) {
+    auto ld = [](const std::atomic<uint64_t>& c) { return c.load(std::memory_order_relaxed); };
+    s.documents      += ld(b.documents);
+    s.sentences      += ld(b.sentences);
+    s.bytesIn        += ld(b.bytesIn);
+    s.bytesOut       += ld(b.bytesOut);
+    s.wordsReplaced  += ld(b.wordsReplaced);
+    s.sentencesSplit += ld(b.sentencesSplit);
+    s.stripNs        += ld(b.ns[kStageStrip]);
+    s.swapNs         += ld(b.ns[kStageSwap]);
+    s.passiveNs      += ld(b.ns[kStagePassive]);
+    s.customNs       += ld(b.ns[kStageCustom]);
+    s.splitNs        += ld(b.ns[kStageSplit]);
+    s.rejoinNs       += ld(b.ns[kStageRejoin]);
+}
+
+// live blocks plus whatever exited threads left behind. never destroyed,
+// so pool threads exiting during static teardown still have it
+struct StatRegistry {
+    std::mutex mu;
+    std::vector<const StatBlock*> live;
+    PipelineStats retired, baseline;
+};
+
+StatRegistry& statRegistry() {
+    static StatRegistry* r = new StatRegistry;
+    return *r;
+}
+
+struct LocalStats {
+    StatBlock block;
+    LocalStats() {
+        auto& r = statRegistry();
+        std::lock_guard<std::mutex> lk(r.mu);
+        r.live.push_back(&block);
+    }
+    ~LocalStats() {
+        auto& r = statRegistry();
+        std::lock_guard<std::mutex> lk(r.mu);
+        addInto(r.retired, block);
+        r.live.erase(std::find(r.live.begin(), r.live.end(), &block));
+    }
+};
+
+std::atomic<bool> gStatsOn{false};
+
+bool statsOn() {
+    return gStatsOn.load(std::memory_order_relaxed);
+}
+
+StatBlock& localStats() {
+    thread_local LocalStats s;
+    return s.block;
+}
+
+// counts only while stats are on
+void countStat(std::atomic<uint64_t> StatBlock::*c, uint64_t v) {
+    if (statsOn()) bump(localStats().*c, v);
+}
+
+// times consecutive stages starting at `first`, when this is one of the
+// sampled runs. does nothing otherwise. each first stage samples on its
+// own tick so timers that always run together don't skew each other
+class StageTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit StageTimer(Stage first) {
+        if (!statsOn()) return;
+        block_ = &localStats();
+        if (block_->tick[first]++ % kStatSample != 0) block_ = nullptr;
+        else last_ = Clock::now();
+    }
+
+    void lap(Stage st) {
+        if (!block_) return;
+        auto now = Clock::now();
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_).count();
+        bump(block_->ns[st], (uint64_t)ns * kStatSample);
+        last_ = now;
+    }
+
+private:
+    StatBlock* block_ = nullptr;
+    Clock::time_point last_;
+};
+
+// r.mu held
+PipelineStats rawStats(const StatRegistry& r) {
+    PipelineStats s = r.retired;
+    for (auto* b : r.live) addInto(s, *b);
+    return s;
+}
+
+} // namespace
+
+void enablePipelineStats(bool on) {
+    gStatsOn.store(on, std::memory_order_relaxed);
+}
+
+// totals since the last reset, over every thread that has done any work
+PipelineStats pipelineStats() {
+    auto& r = statRegistry();
+    std::lock_guard<std::mutex> lk(r.mu);
+    PipelineStats s = rawStats(r);
+    const auto& z = r.baseline;
+    s.documents -= z.documents;           s.sentences -= z.sentences;
+    s.bytesIn -= z.bytesIn;               s.bytesOut -= z.bytesOut;
+    s.wordsReplaced -= z.wordsReplaced;   s.sentencesSplit -= z.sentencesSplit;
+    s.stripNs -= z.stripNs;               s.swapNs -= z.swapNs;
+    s.passiveNs -= z.passiveNs;           s.splitNs -= z.splitNs;
+    s.rejoinNs -= z.rejoinNs;             s.customNs -= z.customNs;
+    return s;
+}
+
+// other threads' blocks can't be written from here, so a reset just
+// moves the zero point
+void resetPipelineStats() {
+    auto& r = statRegistry();
+    std::lock_guard<std::mutex> lk(r.mu);
+    r.baseline = rawStats(r);
+}
+
+// ============================================================
+//  Characters
+// ============================================================
+
+// classification is a table lookup per ascii byte, so nothing depends on
+// the C locale and no char ever reaches a ctype function. bytes from
+// 0x80 up are UTF-8: those get decoded and looked up by code point, with
+// a direct table below U+0800 (latin, greek, cyrillic and friends) and a
+// short list of ranges above it (unicode spaces, quotes, dashes, cjk).
+// text isn't assumed to be valid. a byte that doesn't start a
+// well-formed sequence stands alone and has no class
+
+namespace {
+
+constexpr uint8_t kLetter = 1;
+constexpr uint8_t kVowel  = 2;
+constexpr uint8_t kPunct  = 4;    // for ascii, what std::ispunct says in the C locale
+constexpr uint8_t kDigit  = 8;
+constexpr uint8_t kSpace  = 16;
+constexpr uint8_t kCloser = 32;   // closing quotes and brackets, kept with a . ! ? before them
+constexpr uint8_t kMark   = 64;   // combining accents, soft hyphens, joiners: part of the letter before
+constexpr uint8_t kHiatus = 128;  // a vowel with a diaeresis, which is sounded apart from the one before ("naïve")
+
+constexpr std::array<uint8_t, 256> makeCharClass() {
+    std::array<uint8_t, 256> t{};
+    for (int c = 'a'; c <= 'z'; c++) t[c] = t[c - 'a' + 'A'] = kLetter;
+    for (char c : std::string_view("aeiouy")) {
+        t[(unsigned char)c] |= kVowel;
+        t[(unsigned char)(c - 'a' + 'A')] |= kVowel;
+    }
+    for (char c : std::string_view("!\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~"))
+        t[(unsigned char)c] |= kPunct;
+    for (char c : std::string_view("\"')]"))
+        t[(unsigned char)c] |= kCloser;
+    for (int c = '0'; c <= '9'; c++) t[c] = kDigit;
+    for (char c : std::string_view(" \t\n\r\v\f")) t[(unsigned char)c] = kSpace;
+    return t;
+}
+
+constexpr std::array<uint8_t, 256> kCharClass = makeCharClass();
+
+// [first, last], both code points
+struct CodeSpan {
+    uint32_t first, last;
+};
+
+struct CodeRange {
+    uint32_t first, last;
+    uint8_t cls;
+};
+
+// accented vowels, for syllable counts on borrowed and foreign words
+constexpr CodeSpan kVowelRanges[] = {
+    // latin-1: À-Æ È-Ï Ò-Ö Ø-Ý à-æ è-ï ò-ö ø-ý ÿ
+    { 0xC0, 0xC6 }, { 0xC8, 0xCF }, { 0xD2, 0xD6 }, { 0xD8, 0xDD },
+    { 0xE0, 0xE6 }, { 0xE8, 0xEF }, { 0xF2, 0xF6 }, { 0xF8, 0xFD }, { 0xFF, 0xFF },
+    // latin extended-a: a e i ij o oe u y with macrons, breves, ogoneks...
+    { 0x100, 0x105 }, { 0x112, 0x11B }, { 0x128, 0x133 }, { 0x14C, 0x153 },
+    { 0x168, 0x173 }, { 0x176, 0x178 },
+    // greek, with and without tonos
+    { 0x386, 0x386 }, { 0x388, 0x38A }, { 0x38C, 0x38C }, { 0x38E, 0x391 }, { 0x395, 0x395 },
+    { 0x397, 0x397 }, { 0x399, 0x399 }, { 0x39F, 0x39F }, { 0x3A5, 0x3A5 }, { 0x3A9, 0x3B1 },
+    { 0x3B5, 0x3B5 }, { 0x3B7, 0x3B7 }, { 0x3B9, 0x3B9 }, { 0x3BF, 0x3BF }, { 0x3C5, 0x3C5 },
+    { 0x3C9, 0x3CE },
+    // cyrillic а е и о у ы э ю я, ё є і ї ў, either case
+    { 0x400, 0x401 }, { 0x404, 0x404 }, { 0x406, 0x407 }, { 0x40D, 0x40E }, { 0x410, 0x410 },
+    { 0x415, 0x415 }, { 0x418, 0x418 }, { 0x41E, 0x41E }, { 0x423, 0x423 }, { 0x42B, 0x42B },
+    { 0x42D, 0x430 }, { 0x435, 0x435 }, { 0x438, 0x438 }, { 0x43E, 0x43E }, { 0x443, 0x443 },
+    { 0x44B, 0x44B }, { 0x44D, 0x451 }, { 0x454, 0x454 }, { 0x456, 0x457 }, { 0x45D, 0x45E },
+};
+
+constexpr std::array<uint8_t, 0x800> makeTwoByteClass() {
+    std::array<uint8_t, 0x800> t{};
+    auto set = [&t](uint32_t first, uint32_t last, uint8_t cls) {
+        for (uint32_t c = first; c <= last; c++) t[c] = cls;
+    };
+    set(0xC0, 0x24F, kLetter);      // latin-1 letters, latin extended-a and -b
+    set(0xD7, 0xD7, 0);             // ×
+    set(0xF7, 0xF7, 0);             // ÷
+    set(0x370, 0x52F, kLetter);     // greek, cyrillic
+    set(0x531, 0x587, kLetter);     // armenian
+    set(0x5D0, 0x5EA, kLetter);     // hebrew
+    set(0x620, 0x64A, kLetter);     // arabic
+    set(0x300, 0x36F, kMark);
+    for (auto& r : kVowelRanges)
+        for (uint32_t c = r.first; c <= r.last; c++) t[c] |= kVowel;
+    t[0xA0] = kSpace;               // no-break space
+    t[0xAD] = kMark;                // soft hyphen
+    for (uint32_t c : { 0xA1, 0xA7, 0xAB, 0xB6, 0xB7, 0xBB, 0xBF }) t[c] = kPunct;   // ¡ § « ¶ · » ¿
+    t[0xBB] |= kCloser;
+    for (uint32_t c : { 0xC4, 0xCB, 0xCF, 0xD6, 0xDC, 0xE4, 0xEB, 0xEF, 0xF6, 0xFC, 0xFF }) t[c] |= kHiatus;
+    return t;
+}
+
+constexpr std::array<uint8_t, 0x800> kTwoByteClass = makeTwoByteClass();
+
+// from U+0800 up. sorted, and anything not in here has no class
+constexpr CodeRange kWideRanges[] = {
+    { 0x0900, 0x097F, kLetter },             // devanagari
+    { 0x1E00, 0x1EFF, kLetter },             // latin extended additional
+    { 0x2000, 0x200A, kSpace },              // en quad .. hair space
+    { 0x200B, 0x200F, kMark },               // zero width space, joiners, direction marks
+    { 0x2010, 0x2018, kPunct },              // hyphens, dashes, ‘
+    { 0x2019, 0x2019, kPunct | kCloser },    // ’
+    { 0x201A, 0x201C, kPunct },              // ‚ ‛ “
+    { 0x201D, 0x201D, kPunct | kCloser },    // ”
+    { 0x201E, 0x2027, kPunct },              // „ ‟ † ‡ • ‣ ․ ‥ … ‧
+    { 0x2028, 0x2029, kSpace },              // line and paragraph separators
+    { 0x202A, 0x202E, kMark },               // embedding controls
+    { 0x202F, 0x202F, kSpace },              // narrow no-break space
+    { 0x2030, 0x2039, kPunct },              // ‰ ′ ″ ... ‹
+    { 0x203A, 0x203A, kPunct | kCloser },    // ›
+    { 0x203B, 0x205E, kPunct },
+    { 0x205F, 0x205F, kSpace },              // medium mathematical space
+    { 0x2060, 0x206F, kMark },               // word joiner, invisible operators
+    { 0x3000, 0x3000, kSpace },              // ideographic space
+    { 0x3001, 0x3003, kPunct },              // 、 。 〃
+    { 0x3008, 0x3011, kPunct },              // cjk brackets
+    { 0x3041, 0x30FF, kLetter },             // kana
+    { 0x4E00, 0x9FFF, kLetter },             // cjk ideographs
+    { 0xAC00, 0xD7A3, kLetter },             // hangul
+    { 0xFEFF, 0xFEFF, kMark },               // byte order mark
+};
+
+uint8_t classOf(uint32_t cp) {
+    if (cp < 0x80) return kCharClass[cp];
+    if (cp < 0x800) return kTwoByteClass[cp];
+    auto it = std::upper_bound(std::begin(kWideRanges), std::end(kWideRanges), cp,
+                               [](uint32_t c, const CodeRange& r) { return c < r.first; });
+    if (it == std::begin(kWideRanges) || cp > (--it)->last) return 0;
+    return it->cls;
+}
+
+constexpr uint32_t kBadCodePoint = 0xFFFD;
+
+// the code point starting at s[i], its length in bytes in len. a stray
+// continuation byte, an overlong or surrogate form, or a sequence cut
+// short is one byte long and decodes to kBadCodePoint
+uint32_t decodeAt(std::string_view s, size_t i, size_t& len) {
+    unsigned char c = (unsigned char)s[i];
+    len = 1;
+    if (c < 0x80) return c;
+
+    size_t n;
+    uint32_t cp, min;
+    if (c >= 0xC2 && c <= 0xDF)      { n = 2; cp = c & 0x1F; min = 0x80; }
+    else if (c >= 0xE0 && c <= 0xEF) { n = 3; cp = c & 0x0F; min = 0x800; }
+    else if (c >= 0xF0 && c <= 0xF4) { n = 4; cp = c & 0x07; min = 0x10000; }
+    else return kBadCodePoint;
+    if (i + n > s.size()) return kBadCodePoint;
+    for (size_t k = 1; k < n; k++) {
+        unsigned char b = (unsigned char)s[i + k];
+        if ((b & 0xC0) != 0x80) return kBadCodePoint;
+        cp = cp << 6 | (b & 0x3F);
+    }
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return kBadCodePoint;
+    len = n;
+    return cp;
+}
+
+// true if s[i] starts a multi-byte sequence that runs past the end of s,
+// i.e. the rest of the character hasn't arrived yet
+bool cutShort(std::string_view s, size_t i) {
+    unsigned char c = (unsigned char)s[i];
+    size_t n = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+    return i + n > s.size();
+}
+
+// class of the character at s[i], its length in len. ascii costs the
+// table lookup and nothing else
+inline uint8_t classAt(std::string_view s, size_t i, size_t& len) {
+    unsigned char c = (unsigned char)s[i];
+    if (c < 0x80) {
+        len = 1;
+        return kCharClass[c];
+    }
+    uint32_t cp = decodeAt(s, i, len);
+    return len == 1 ? 0 : classOf(cp);
+}
+
+// same for the character that ends right before s[end]
+inline uint8_t classBefore(std::string_view s, size_t end, size_t& len) {
+    unsigned char c = (unsigned char)s[end - 1];
+    if (c < 0x80) {
+        len = 1;
+        return kCharClass[c];
+    }
+    size_t i = end - 1;
+    size_t stop = end > 4 ? end - 4 : 0;
+    while (i > stop && ((unsigned char)s[i] & 0xC0) == 0x80) i--;
+    uint8_t cls = classAt(s, i, len);
+    if (i + len == end) return cls;
+    len = 1;
+    return 0;
+}
+
+// how many bytes of whitespace start at s[i], 0 if it isn't whitespace
+inline size_t spaceAt(std::string_view s, size_t i) {
+    unsigned char c = (unsigned char)s[i];
+    if (c < 0x80) return (kCharClass[c] & kSpace) ? 1 : 0;
+    size_t len;
+    return (classAt(s, i, len) & kSpace) ? len : 0;
+}
+
+// where w's trailing punctuation starts ("word.”" -> 4). these run on
+// every token, so ascii doesn't leave the loop
+inline size_t coreEnd(std::string_view w) {
+    size_t n = w.size(), len;
+    while (n > 0) {
+        unsigned char c = (unsigned char)w[n - 1];
+        if (c < 0x80) {
+            if (!(kCharClass[c] & kPunct)) break;
+            n--;
+        } else {
+            if (!(classBefore(w, n, len) & kPunct)) break;
+            n -= len;
+        }
+    }
+    return n;
+}
+
+// where w's leading punctuation ends ("«word" -> 2)
+inline size_t coreStart(std::string_view w) {
+    size_t i = 0, len;
+    while (i < w.size()) {
+        unsigned char c = (unsigned char)w[i];
+        if (c < 0x80) {
+            if (!(kCharClass[c] & kPunct)) break;
+            i++;
+        } else {
+            if (!(classAt(w, i, len) & kPunct)) break;
+            i += len;
+        }
+    }
+    return i;
+}
+
+// the other case of an ascii, latin-1, latin extended-a, greek or
+// cyrillic letter, or cp itself when there is none. both cases of every
+// pair here take the same number of bytes, so recasing works in place
+uint32_t upperOf(uint32_t cp) {
+    if (cp >= 'a' && cp <= 'z') return cp - 0x20;
+    if (cp < 0xE0) return cp;
+    if (cp <= 0xFE) return cp == 0xF7 ? cp : cp - 0x20;
+    if (cp == 0xFF) return 0x178;
+    if ((cp >= 0x100 && cp <= 0x12F) || (cp >= 0x132 && cp <= 0x137) || (cp >= 0x14A && cp <= 0x177))
+        return cp & ~1u;
+    if ((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17E)) return (cp & 1) ? cp : cp - 1;
+    if (cp >= 0x3B1 && cp <= 0x3C9 && cp != 0x3C2) return cp - 0x20;
+    if (cp >= 0x430 && cp <= 0x44F) return cp - 0x20;
+    if (cp >= 0x450 && cp <= 0x45F) return cp - 0x50;
+    return cp;
+}
+
+uint32_t lowerOf(uint32_t cp) {
+    if (cp >= 'A' && cp <= 'Z') return cp + 0x20;
+    if (cp < 0xC0) return cp;
+    if (cp <= 0xDE) return cp == 0xD7 ? cp : cp + 0x20;
+    if (cp == 0x178) return 0xFF;
+    if ((cp >= 0x100 && cp <= 0x12F) || (cp >= 0x132 && cp <= 0x137) || (cp >= 0x14A && cp <= 0x177))
+        return cp | 1;
+    if ((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17E)) return (cp & 1) ? cp + 1 : cp;
+    if (cp >= 0x391 && cp <= 0x3A9 && cp != 0x3A2) return cp + 0x20;
+    if (cp >= 0x410 && cp <= 0x42F) return cp + 0x20;
+    if (cp >= 0x400 && cp <= 0x40F) return cp + 0x50;
+    return cp;
+}
+
+// upper- or lowercases the letter starting at s[i], if it has a case
+template <typename Str>
+void recaseAt(Str& s, size_t i, bool upper) {
+    size_t len;
+    uint32_t cp = decodeAt(s, i, len);
+    uint32_t to = upper ? upperOf(cp) : lowerOf(cp);
+    if (to == cp) return;
+    if (len == 1) {
+        s[i] = (char)to;
+    } else {
+        s[i]     = (char)(0xC0 | to >> 6);
+        s[i + 1] = (char)(0x80 | (to & 0x3F));
+    }
+}
+
+bool isUpperAt(std::string_view s, size_t i) {
+    size_t len;
+    uint32_t cp = decodeAt(s, i, len);
+    return lowerOf(cp) != cp;
+}
+
+} // namespace
+
+// ============================================================
+//  Tokenizer
+// ============================================================
+
+// everything downstream used to re-split the text with its own
+// istringstream. this does it once and hands back views into the
+// caller's buffer, so the buffer has to outlive the result
+
+namespace {
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+bool isTerminator(char c) {
+    return c == '.' || c == '!' || c == '?';
+}
+
+// ascii space or the first byte of a multi-byte one (not all of them are)
+bool isSpaceStart(char c) {
+    return isSpace(c) || c == '\xC2' || c == '\xE2' || c == '\xE3';
+}
+
+// s ends a sentence: . ! or ? with nothing after but closing quotes and
+// brackets
+bool terminated(std::string_view s) {
+    size_t n = s.size(), len;
+    while (n > 0 && (classBefore(s, n, len) & kCloser)) n -= len;
+    return n > 0 && isTerminator(s[n - 1]);
+}
+
+constexpr char asciiLower(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+}
+
+constexpr char asciiUpper(char c) {
+    return (c >= 'a' && c <= 'z') ? (char)(c - ('a' - 'A')) : c;
+}
+
+constexpr bool ciEqual(std::string_view a, std::string_view lower) {
+    if (a.size() != lower.size()) return false;
+    for (size_t i = 0; i < a.size(); i++)
+        if (asciiLower(a[i]) != lower[i]) return false;
+    return true;
+}
+
+// fnv-1a over the case-folded bytes
+constexpr uint32_t ciHash(std::string_view s, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : s) {
+        h ^= (unsigned char)asciiLower(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// the scanners below only care about a handful of byte values (space
+// class and . ! ?), so they test a whole block at once and only drop to
+// scalar code at the bytes that matched. plain words get skipped in bulk.
+// spaces also matches the first byte of every multi-byte space (C2 for
+// U+00A0, E2 for U+2000 and up, E3 for U+3000), so callers looking for
+// spaces confirm each match with spaceAt
+
+#if defined(__AVX2__)
+
+constexpr size_t kScanBlock = 32;
+
+inline uint32_t matchMask(const char* p, bool spaces, bool terms) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i m = _mm256_setzero_si256();
+    auto eq = [&](char c) { m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(c))); };
+    if (terms)  { eq('.'); eq('!'); eq('?'); }
+    if (spaces) {
+        // ' ', \t..\r as one range check, and the lead bytes C2 E2 E3
+        __m256i ctl = _mm256_sub_epi8(x, _mm256_set1_epi8(9));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(_mm256_min_epu8(ctl, _mm256_set1_epi8(4)), ctl));
+        eq(' '); eq('\xC2');
+        __m256i lead = _mm256_and_si256(x, _mm256_set1_epi8((char)0xFE));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(lead, _mm256_set1_epi8((char)0xE2)));
+    }
+    return (uint32_t)_mm256_movemask_epi8(m);
+}
+
+inline bool allAscii(const char* p) {
+    return _mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))) == 0;
+}
+
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+constexpr size_t kScanBlock = 16;
+
+inline uint32_t matchMask(const char* p, bool spaces, bool terms) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i m = _mm_setzero_si128();
+    auto eq = [&](char c) { m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8(c))); };
+    if (terms)  { eq('.'); eq('!'); eq('?'); }
+    if (spaces) {
+        // ' ', \t..\r as one range check, and the lead bytes C2 E2 E3
+        __m128i ctl = _mm_sub_epi8(x, _mm_set1_epi8(9));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(ctl, _mm_set1_epi8(4)), ctl));
+        eq(' '); eq('\xC2');
+        __m128i lead = _mm_and_si128(x, _mm_set1_epi8((char)0xFE));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(lead, _mm_set1_epi8((char)0xE2)));
+    }
+    return (uint32_t)_mm_movemask_epi8(m);
+}
+
+inline bool allAscii(const char* p) {
+    return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))) == 0;
+}
+
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+
+constexpr size_t kScanBlock = 16;
+
+inline uint32_t matchMask(const char* p, bool spaces, bool terms) {
+    uint8x16_t x = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+    uint8x16_t m = vdupq_n_u8(0);
+    auto eq = [&](char c) { m = vorrq_u8(m, vceqq_u8(x, vdupq_n_u8((uint8_t)c))); };
+    if (terms)  { eq('.'); eq('!'); eq('?'); }
+    if (spaces) {
+        // ' ', \t..\r as one range check, and the lead bytes C2 E2 E3
+        m = vorrq_u8(m, vcltq_u8(vsubq_u8(x, vdupq_n_u8(9)), vdupq_n_u8(5)));
+        eq(' '); eq('\xC2');
+        m = vorrq_u8(m, vceqq_u8(vandq_u8(x, vdupq_n_u8(0xFE)), vdupq_n_u8(0xE2)));
+    }
+    // no movemask on neon: weight each lane by its bit and add across halves
+    static const uint8_t kBits[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t b = vandq_u8(m, vld1q_u8(kBits));
+    return (uint32_t)vaddv_u8(vget_low_u8(b)) | ((uint32_t)vaddv_u8(vget_high_u8(b)) << 8);
+}
+
+inline bool allAscii(const char* p) {
+    return vmaxvq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(p))) < 0x80;
+}
+
+#else
+
+constexpr size_t kScanBlock = 16;
+
+inline uint32_t matchMask(const char* p, bool spaces, bool terms) {
+    uint32_t m = 0;
+    for (size_t i = 0; i < kScanBlock; i++)
+        if ((terms && isTerminator(p[i])) || (spaces && isSpaceStart(p[i]))) m |= 1u << i;
+    return m;
+}
+
+inline bool allAscii(const char* p) {
+    uint64_t a, b;
+    std::memcpy(&a, p, 8);
+    std::memcpy(&b, p + 8, 8);
+    return ((a | b) & 0x8080808080808080ull) == 0;
+}
+
+#endif
+
+inline unsigned lowestBit(uint32_t m) {
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward(&i, m);
+    return (unsigned)i;
+#else
+    return (unsigned)__builtin_ctz(m);
+#endif
+}
+
+// calls fn(i) for each matching byte from `from` on, in order, until fn
+// returns true
+template <typename Fn>
+void forEachMatch(std::string_view text, size_t from, bool spaces, bool terms, Fn&& fn) {
+    size_t i = from;
+    size_t n = text.size();
+    for (; i + kScanBlock <= n; i += kScanBlock) {
+        uint32_t m = matchMask(text.data() + i, spaces, terms);
+        while (m) {
+            size_t j = i + lowestBit(m);
+            m &= m - 1;
+            if (fn(j)) return;
+        }
+    }
+    for (; i < n; i++)
+        if ((terms && isTerminator(text[i])) || (spaces && isSpaceStart(text[i])))
+            if (fn(i)) return;
+}
+
+bool isAscii(std::string_view s) {
+    size_t i = 0;
+    for (; i + kScanBlock <= s.size(); i += kScanBlock)
+        if (!allAscii(s.data() + i)) return false;
+    unsigned char high = 0;
+    for (; i < s.size(); i++) high |= (unsigned char)s[i];
+    return high < 0x80;
+}
+
+// true if s is well-formed UTF-8. ascii goes by a block at a time, and
+// only what's left from the first non-ascii byte of a block gets decoded
+bool validUtf8(std::string_view s) {
+    size_t i = 0;
+    while (i < s.size()) {
+        if (i + kScanBlock <= s.size() && allAscii(s.data() + i)) {
+            i += kScanBlock;
+            continue;
+        }
+        size_t end = std::min(s.size(), i + kScanBlock);
+        while (i < end) {
+            size_t len;
+            decodeAt(s, i, len);
+            if (len == 1 && (unsigned char)s[i] >= 0x80) return false;
+            i += len;
+        }
+    }
+    return true;
+}
+
+// a period after one of these doesn't end the sentence. "etc." and "inc."
+// are left out on purpose, they end sentences about as often as not
+constexpr std::string_view kAbbreviations[] = {
+    "mr", "mrs", "ms", "dr", "prof", "sr", "jr", "st", "mt", "vs",
+    "gen", "gov", "sen", "rep", "e.g", "i.e", "cf", "al", "approx",
+};
+
+bool isAbbreviation(std::string_view tok) {
+    // ("Dr. -> dr, but "ÉDr." keeps its É and isn't one
+    size_t len;
+    while (!tok.empty() && !(classAt(tok, 0, len) & (kLetter | kDigit))) tok.remove_prefix(len);
+    for (auto a : kAbbreviations)
+        if (ciEqual(tok, a)) return true;
+    return false;
+}
+
+} // namespace
+
+struct TokenizedText {
+    struct WordRange {
+        const std::string_view* first;
+        const std::string_view* last;
+        const std::string_view* begin() const { return first; }
+        const std::string_view* end()   const { return last; }
+        size_t size() const { return last - first; }
+    };
+
+    explicit TokenizedText(std::pmr::memory_resource* mr = std::pmr::get_default_resource())
+        : sentences(mr), words(mr), firstWord(mr) {}
+
+    std::pmr::vector<std::string_view> sentences;
+    std::pmr::vector<std::string_view> words;
+    std::pmr::vector<size_t> firstWord;   // words of sentence i: [firstWord[i], firstWord[i+1])
+
+    WordRange wordsOf(size_t i) const {
+        return { words.data() + firstWord[i], words.data() + firstWord[i + 1] };
+    }
+};
+
+class Tokenizer {
+public:
+    // sentences end after a run of . ! or ?, whatever is left over at the
+    // end becomes one last (unterminated) sentence. a period doesn't end
+    // anything when it's glued to the next character (3.5, e.g., U.S.,
+    // example.com) or follows a known abbreviation (Dr. Smith). words are
+    // whitespace separated and never cross a sentence boundary
+    static TokenizedText tokenize(std::string_view text) {
+        return tokenize(text, true);
+    }
+
+    // pass withWords = false when only sentence spans are needed. the span
+    // vectors are allocated from mr
+    static TokenizedText tokenize(std::string_view text, bool withWords,
+                                  std::pmr::memory_resource* mr = std::pmr::get_default_resource());
+
+    // word spans only, for when we already have a single sentence
+    template <typename Vec>
+    static void words(std::string_view s, Vec& out) {
+        out.clear();
+        size_t pos = 0;
+        forEachMatch(s, 0, true, false, [&](size_t i) {
+            size_t sp = spaceAt(s, i);
+            if (!sp) return false;
+            if (i > pos) out.push_back(s.substr(pos, i - pos));
+            pos = i + sp;
+            return false;
+        });
+        if (s.size() > pos) out.push_back(s.substr(pos));
+    }
+
+    // text[i] is a terminator of the sentence starting at sentStart.
+    // returns the end of the sentence if it ends here, 0 if it doesn't and
+    // npos if that depends on bytes past the end of text (only when
+    // atEnd is false, i.e. more input is coming). closing quotes and
+    // brackets straight after the terminators end the sentence with them
+    static size_t boundaryAt(std::string_view text, size_t sentStart, size_t i, bool atEnd) {
+        constexpr size_t npos = std::string_view::npos;
+        size_t terms = i + 1;
+        while (terms < text.size() && isTerminator(text[terms])) terms++;
+        size_t end = terms, len;
+        while (end < text.size() && (classAt(text, end, len) & kCloser)) end += len;
+        if (end == text.size()) return atEnd ? end : npos;
+        if (!atEnd && cutShort(text, end)) return npos;
+        if (terms > i + 1 || text[i] != '.') return end;
+
+        // a lone period
+        if (end == terms && (classAt(text, end, len) & (kLetter | kDigit))) return 0;
+        size_t ts = i;
+        while (ts > sentStart && !(classBefore(text, ts, len) & kSpace)) ts--;
+        return isAbbreviation(text.substr(ts, i - ts)) ? 0 : end;
+    }
+
+    // end of the first sentence boundary at or after `from`, for callers
+    // feeding text in pieces. npos if there isn't one yet, with resume set
+    // to where the next call should start looking
+    static size_t nextBoundary(std::string_view text, size_t sentStart, size_t from,
+                               bool atEnd, size_t& resume) {
+        size_t found = std::string_view::npos;
+        resume = text.size();
+        forEachMatch(text, from, false, true, [&](size_t i) {
+            size_t end = boundaryAt(text, sentStart, i, atEnd);
+            if (end == 0) return false;
+            if (end == std::string_view::npos) resume = i;
+            else found = end;
+            return true;
+        });
+        return found;
+    }
+};
+
+TokenizedText Tokenizer::tokenize(std::string_view text, bool withWords,
+                                  std::pmr::memory_resource* mr) {
+    TokenizedText t(mr);
+    t.sentences.reserve(text.size() / 64 + 1);
+    if (withWords) t.words.reserve(text.size() / 5 + 1);
+    t.firstWord.push_back(0);
+
+    constexpr size_t npos = std::string_view::npos;
+    size_t sentStart = 0;
+
+    if (!withWords) {
+        size_t skip = 0;
+        forEachMatch(text, 0, false, true, [&](size_t i) {
+            if (i < skip) return false;
+            size_t end = boundaryAt(text, sentStart, i, true);
+            if (end == 0) return false;
+            t.sentences.push_back(text.substr(sentStart, end - sentStart));
+            sentStart = skip = end;
+            return false;
+        });
+        if (sentStart < text.size()) t.sentences.push_back(text.substr(sentStart));
+        return t;
+    }
+
+    // only matched bytes are visited, so everything between `pos` and the
+    // current match is known to be plain word characters
+    size_t wordStart = npos;
+    size_t pos = 0;
+    size_t skip = 0;
+    forEachMatch(text, 0, true, true, [&](size_t i) {
+        if (i < skip) return false;
+        bool term = isTerminator(text[i]);
+        size_t sp = term ? 0 : spaceAt(text, i);
+        if (!term && !sp) return false;
+        if (wordStart == npos && i > pos) wordStart = pos;
+        pos = i + (term ? 1 : sp);
+
+        if (sp) {
+            if (wordStart != npos) {
+                t.words.push_back(text.substr(wordStart, i - wordStart));
+                wordStart = npos;
+            }
+            return false;
+        }
+
+        if (wordStart == npos) wordStart = i;
+        size_t end = boundaryAt(text, sentStart, i, true);
+        if (end == 0) return false;
+        t.words.push_back(text.substr(wordStart, end - wordStart));
+        wordStart = npos;
+        t.sentences.push_back(text.substr(sentStart, end - sentStart));
+        t.firstWord.push_back(t.words.size());
+        sentStart = pos = skip = end;
+        return false;
+    });
+    if (wordStart == npos && text.size() > pos) wordStart = pos;
+
+    if (wordStart != npos)
+        t.words.push_back(text.substr(wordStart));
+    if (sentStart < text.size()) {
+        t.sentences.push_back(text.substr(sentStart));
+        t.firstWord.push_back(t.words.size());
+    }
+    return t;
+}
 
 // ============================================================
 //  TextAnalyzer
 // ============================================================
 
-// this is rough but the results seem reasonable enough
-int TextAnalyzer::countSyllables(const std::string& rawWord) {
-    std::string word = rawWord;
-    std::transform(word.begin(), word.end(), word.begin(), ::tolower);
+namespace {
 
+// LettersOnly skips anything that isn't a letter as if it had been
+// filtered out first, which is what scoring wants ("don't" -> "dont").
+// letters gets the number of characters that were counted. accents,
+// combined or not, count as part of their letter ("café" has two)
+template <bool LettersOnly>
+int syllablesOfUtf8(std::string_view word, size_t& letters) {
     int n = 0;
     bool lastWasVowel = false;
-    std::string vowels = "aeiouy";
+    uint32_t last = 0;
+    letters = 0;
 
-    for (char c : word) {
-        bool v = vowels.find(c) != std::string::npos;
-        if (v && !lastWasVowel) n++;
+    for (size_t i = 0; i < word.size();) {
+        size_t len;
+        uint32_t c = decodeAt(word, i, len);
+        uint8_t cls = len == 1 ? kCharClass[(unsigned char)word[i]] : classOf(c);
+        i += len;
+        if (cls & kMark) continue;
+        if (LettersOnly && !(cls & kLetter)) continue;
+        bool v = cls & kVowel;
+        n += v && (!lastWasVowel || (cls & kHiatus));
+        lastWasVowel = v;
+        last = c;
+        letters++;
+    }
+
+    // silent e at the end
+    if (letters > 2 && (last | 0x20) == 'e')
+        n--;
+
+    return std::max(1, n);
+}
+
+// the byte loop, for words known to be plain ascii
+template <bool LettersOnly>
+int syllablesOfAscii(std::string_view word, size_t& letters) {
+    int n = 0;
+    bool lastWasVowel = false;
+    unsigned char last = 0;
+    letters = 0;
+
+    for (unsigned char c : word) {
+        uint8_t cls = kCharClass[c];
+        if (LettersOnly && !(cls & kLetter)) continue;
+        bool v = cls & kVowel;
+        n += v && !lastWasVowel;
         lastWasVowel = v;
+        last = c;
+        letters++;
     }
 
     // silent e at the end
-    if (word.size() > 2 && word.back() == 'e')
+    if (letters > 2 && (last | 0x20) == 'e')
         n--;
 
     return std::max(1, n);
 }
 
+} // namespace
+
+// this is rough but the results seem reasonable enough
+int TextAnalyzer::countSyllables(std::string_view word) {
+    size_t letters;
+    return isAscii(word) ? syllablesOfAscii<false>(word, letters) : syllablesOfUtf8<false>(word, letters);
+}
+
 double TextAnalyzer::calcFlesch(double wps, double spw) {
     return 206.835 - (1.015 * wps) - (84.6 * spw);
 }
 
-TextAnalyzer::Metrics TextAnalyzer::analyze(const std::string& text) {
-    Metrics m;
+namespace {
 
-    std::vector<std::string> sentences;
-    std::string cur;
-    for (char c : text) {
-        cur += c;
-        if (c == '.' || c == '!' || c == '?') {
-            sentences.push_back(cur);
-            cur.clear();
-        }
+template <bool Ascii, typename Words>
+void tallyWords(const Words& toks, int& words, int& syllables) {
+    for (std::string_view tok : toks) {
+        size_t letters;
+        int n = Ascii ? syllablesOfAscii<true>(tok, letters) : syllablesOfUtf8<true>(tok, letters);
+        if (letters == 0) continue;
+        words++;
+        syllables += n;
     }
+}
+
+// adds the alpha-only tokens of one sentence to the running totals.
+// tokens with no letters at all (dashes, bullets) don't count as words.
+// toks are the tokenizer's views, in order into one buffer, so one check
+// over the bytes they span says whether the ascii loop will do
+template <typename Words>
+void tallyWords(const Words& toks, int& words, int& syllables) {
+    if (toks.size() == 0) return;
+    std::string_view first = *toks.begin(), last = *(toks.end() - 1);
+    std::string_view span(first.data(), last.data() + last.size() - first.data());
+    if (isAscii(span)) tallyWords<true>(toks, words, syllables);
+    else tallyWords<false>(toks, words, syllables);
+}
+
+} // namespace
 
-    if (sentences.empty()) return m;
+TextAnalyzer::Metrics TextAnalyzer::analyze(std::string_view text) {
+    auto tt = Tokenizer::tokenize(text);
+
+    // an unterminated tail isn't a sentence as far as scoring goes
+    size_t nSent = tt.sentences.size();
+    if (nSent > 0 && !terminated(tt.sentences.back())) nSent--;
 
     int totalWords = 0;
     int totalSyllables = 0;
+    for (size_t i = 0; i < nSent; i++)
+        tallyWords(tt.wordsOf(i), totalWords, totalSyllables);
+
+    return score((int)nSent, totalWords, totalSyllables);
+}
+
+TextAnalyzer::Metrics TextAnalyzer::score(int sentences, int words, int syllables) {
+    Metrics m;
+    if (sentences == 0) return m;
+
+    m.avgWordsPerSentence = (double)words / sentences;
+    m.avgSyllablesPerWord = words > 0 ? (double)syllables / words : 0.0;
+    m.fleschScore = calcFlesch(m.avgWordsPerSentence, m.avgSyllablesPerWord);
+
+    // these cutoffs are kind of made up, calibrate later
+    double f = m.fleschScore;
+    if      (f >= 80) m.cefrEstimate = 1;
+    else if (f >= 65) m.cefrEstimate = 2;
+    else if (f >= 50) m.cefrEstimate = 3;
+    else if (f >= 40) m.cefrEstimate = 4;
+    else if (f >= 25) m.cefrEstimate = 5;
+    else              m.cefrEstimate = 6;
+
+    return m;
+}
+
+// keeps per-sentence counts so an editor can re-score after touching a few
+// sentences without re-reading the document. updates cost the sentences
+// changed (plus shifting a small struct per sentence after the edit
+// point), metrics() is O(1). pieces are whatever the caller treats as a
+// sentence; the metrics match analyze() of the concatenated text as long
+// as pieces are split at sentence boundaries
+class IncrementalAnalyzer {
+public:
+    IncrementalAnalyzer() = default;
+
+    explicit IncrementalAnalyzer(std::string_view text) {
+        auto tt = Tokenizer::tokenize(text);
+        counts_.reserve(tt.sentences.size());
+        for (size_t i = 0; i < tt.sentences.size(); i++) {
+            Counts c;
+            if (terminated(tt.sentences[i])) {
+                c.sentences = 1;
+                tallyWords(tt.wordsOf(i), c.words, c.syllables);
+            }
+            add(c);
+            counts_.push_back(c);
+        }
+    }
+
+    size_t size() const { return counts_.size(); }
+
+    void insert(size_t index, std::string_view sentence) {
+        if (index > counts_.size()) throw std::out_of_range("IncrementalAnalyzer::insert");
+        Counts c = count(sentence);
+        add(c);
+        counts_.insert(counts_.begin() + index, c);
+    }
+
+    void erase(size_t index, size_t n = 1) {
+        if (index + n > counts_.size()) throw std::out_of_range("IncrementalAnalyzer::erase");
+        for (size_t i = index; i < index + n; i++) remove(counts_[i]);
+        counts_.erase(counts_.begin() + index, counts_.begin() + index + n);
+    }
+
+    void replace(size_t index, std::string_view sentence) {
+        if (index >= counts_.size()) throw std::out_of_range("IncrementalAnalyzer::replace");
+        remove(counts_[index]);
+        counts_[index] = count(sentence);
+        add(counts_[index]);
+    }
+
+    TextAnalyzer::Metrics metrics() const {
+        return TextAnalyzer::score(total_.sentences, total_.words, total_.syllables);
+    }
+
+private:
+    struct Counts {
+        int sentences = 0;
+        int words = 0;
+        int syllables = 0;
+    };
+
+    // a piece can hold more than one sentence (or none, if it's an
+    // unterminated fragment), same rules as analyze()
+    static Counts count(std::string_view piece) {
+        auto tt = Tokenizer::tokenize(piece);
+        Counts c;
+        for (size_t i = 0; i < tt.sentences.size(); i++) {
+            if (!terminated(tt.sentences[i])) continue;
+            c.sentences++;
+            tallyWords(tt.wordsOf(i), c.words, c.syllables);
+        }
+        return c;
+    }
+
+    void add(const Counts& c) {
+        total_.sentences += c.sentences;
+        total_.words     += c.words;
+        total_.syllables += c.syllables;
+    }
+
+    void remove(const Counts& c) {
+        total_.sentences -= c.sentences;
+        total_.words     -= c.words;
+        total_.syllables -= c.syllables;
+    }
+
+    std::vector<Counts> counts_;
+    Counts total_;
+};
+
+// ============================================================
+//  Vocabulary
+// ============================================================
+
+// the built-in word list. it's compiled into the same automaton as a
+// lexicon file's (see Phrase matching), and swaps and lookups all go
+// through that, so every way of asking sees the same entries
+
+namespace {
+
+struct LexEntry {
+    std::string_view word;
+    std::string_view simpler;
+    CEFRLevel level;   // lowest level that gets this swap
+};
+
+constexpr LexEntry kLexicon[] = {
+    // keeping this small for now
+    {"utilize",      "use",    CEFRLevel::A1},
+    {"commence",     "start",  CEFRLevel::A1},
+    {"terminate",    "end",    CEFRLevel::A1},
+    {"residence",    "home",   CEFRLevel::A1},
+    {"purchase",     "buy",    CEFRLevel::A1},
+    {"inquire",      "ask",    CEFRLevel::A1},
+    {"observe",      "see",    CEFRLevel::A1},
+    {"obtain",       "get",    CEFRLevel::A1},
+    {"assistance",   "help",   CEFRLevel::A1},
+    {"demonstrate",  "show",   CEFRLevel::A1},
+    {"approximately","about",  CEFRLevel::A1},
+    {"sufficient",   "enough", CEFRLevel::A1},
+    {"however",      "but",    CEFRLevel::A1},
+    {"therefore",    "so",     CEFRLevel::A1},
+    {"additionally", "also",   CEFRLevel::A1},
+    {"attempt",      "try",    CEFRLevel::A1},
+    {"require",      "need",   CEFRLevel::A1},
+
+    // phrases go through the same table, matched over whole words
+    {"in order to",            "to",      CEFRLevel::A1},
+    {"a large number of",      "many",    CEFRLevel::A1},
+    {"prior to",               "before",  CEFRLevel::A1},
+    {"due to the fact that",   "because", CEFRLevel::A1},
+    {"at this point in time",  "now",     CEFRLevel::A1},
+    {"in addition",            "also",    CEFRLevel::A1},
+
+    // A2 can handle a bit more
+    {"facilitate",   "help",   CEFRLevel::A2},
+    {"construct",    "build",  CEFRLevel::A2},
+    {"complete",     "finish", CEFRLevel::A2},
+    {"numerous",     "many",   CEFRLevel::A2},
+    {"previously",   "before", CEFRLevel::A2},
+    {"in the event that",      "if",      CEFRLevel::A2},
+    {"with regard to",         "about",   CEFRLevel::A2},
+    // TODO: this needs to be way bigger, maybe pull from Oxford 3000
+};
+
+constexpr size_t kLexiconSize = sizeof(kLexicon) / sizeof(kLexicon[0]);
+
+} // namespace
+
+// ============================================================
+//  Phrase matching
+// ============================================================
+
+// every lexicon entry, single words and phrases alike, compiled into one
+// Aho-Corasick automaton over lowercase bytes. a sentence's words are fed
+// through it once, joined by single spaces, so the cost per word doesn't
+// grow with the lexicon. the automaton is kept compact, each node's goto
+// edges as a sorted list plus a fail link, so it's about the size of the
+// keys and a lexicon file can hold it as is to be mapped and used in
+// place. the shallowest nodes, which nearly every step passes through,
+// also get full transition rows over the byte classes they use. that's a
+// fixed budget filled in when the matcher is made, so it costs the same
+// for any lexicon
+//
+// inflected forms are added when the automaton is built: every single
+// word entry also gets its -s, -ed and -ing forms mapped to the same
+// forms of its replacement ("utilizes" -> "uses"), so the lexicon only
+// needs the base form and nothing gets stemmed per word at run time. for
+// lexicon files that's done once by compile-lexicon, not at every load
+
+namespace {
+
+enum class Inflection { S, Past, Ing };
+
+// simple verbs whose forms don't follow the rules below. where the past
+// and the participle differ (saw/seen) there's no one form to put back,
+// so those words keep their original past forms
+struct Irregular {
+    std::string_view base, s, past, participle;
+};
+
+constexpr Irregular kIrregular[] = {
+    {"be",    "is",    "was",     "been"},
+    {"buy",   "buys",  "bought",  "bought"},
+    {"build", "builds","built",   "built"},
+    {"do",    "does",  "did",     "done"},
+    {"find",  "finds", "found",   "found"},
+    {"get",   "gets",  "got",     "got"},
+    {"give",  "gives", "gave",    "given"},
+    {"go",    "goes",  "went",    "gone"},
+    {"have",  "has",   "had",     "had"},
+    {"keep",  "keeps", "kept",    "kept"},
+    {"make",  "makes", "made",    "made"},
+    {"pay",   "pays",  "paid",    "paid"},
+    {"say",   "says",  "said",    "said"},
+    {"see",   "sees",  "saw",     "seen"},
+    {"send",  "sends", "sent",    "sent"},
+    {"show",  "shows", "showed",  "shown"},
+    {"take",  "takes", "took",    "taken"},
+    {"tell",  "tells", "told",    "told"},
+    {"think", "thinks","thought", "thought"},
+};
+
+// replacements with nothing to inflect, so the entry only matches as is
+constexpr std::string_view kUninflected[] = {
+    "about", "also", "because", "before", "but", "enough",
+    "if", "many", "now", "so", "to",
+};
+
+bool isPlainVowel(char c) {
+    return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u';
+}
+
+// short consonant-vowel-consonant words double the last letter before
+// -ed/-ing (get -> getting). longer ones mostly don't (visit -> visited)
+bool doublesLast(std::string_view w) {
+    return w.size() == 3 && !isPlainVowel(w[0]) && isPlainVowel(w[1]) && !isPlainVowel(w[2]) &&
+           w[2] != 'w' && w[2] != 'x' && w[2] != 'y';
+}
+
+bool endsWith(std::string_view w, std::string_view tail) {
+    return w.size() >= tail.size() && w.substr(w.size() - tail.size()) == tail;
+}
+
+// lowercase w with the given ending into out. false if there's no single
+// form to use
+bool inflect(std::string_view w, Inflection f, std::string& out) {
+    if (w.empty()) return false;
+    for (auto& irr : kIrregular) {
+        if (irr.base != w || f == Inflection::Ing) continue;
+        if (f == Inflection::Past && irr.past != irr.participle) return false;
+        out.assign(f == Inflection::S ? irr.s : irr.past);
+        return true;
+    }
+
+    out.assign(w.data(), w.size());
+    char last = w.back();
+    bool consonantY = last == 'y' && w.size() > 1 && !isPlainVowel(w[w.size() - 2]);
+    switch (f) {
+    case Inflection::S:
+        if (consonantY) {
+            out.back() = 'i';
+            out += "es";
+        } else if (last == 's' || last == 'x' || last == 'z' || endsWith(w, "ch") || endsWith(w, "sh")) {
+            out += "es";
+        } else {
+            out += 's';
+        }
+        break;
+    case Inflection::Past:
+        if (consonantY) {
+            out.back() = 'i';
+            out += "ed";
+        } else if (last == 'e') {
+            out += 'd';
+        } else {
+            if (doublesLast(w)) out += last;
+            out += "ed";
+        }
+        break;
+    case Inflection::Ing:
+        // use -> using, but see -> seeing
+        if (endsWith(w, "ie")) {
+            out.resize(out.size() - 2);
+            out += "ying";
+        } else if (last == 'e' && w.size() > 2 && !isPlainVowel(w[w.size() - 2])) {
+            out.back() = 'i';
+            out += "ng";
+        } else {
+            if (doublesLast(w)) out += last;
+            out += "ing";
+        }
+        break;
+    }
+    return true;
+}
+
+bool inflectable(std::string_view word, std::string_view simpler) {
+    auto letters = [](std::string_view w) {
+        return !w.empty() && std::all_of(w.begin(), w.end(), [](char c) { return c >= 'a' && c <= 'z'; });
+    };
+    if (!letters(word) || !letters(simpler)) return false;
+    return std::find(std::begin(kUninflected), std::end(kUninflected), simpler) == std::end(kUninflected);
+}
+
+} // namespace
+
+// the automaton's tables, in the layout lexicon files store them. node 0
+// is the root and nodes are numbered breadth first, so a fail or dict
+// link always points to a lower number and an edge to a higher one.
+// that's what lets a matcher over a file nobody checked stay inside its
+// tables (and out of loops) without reading the whole file up front
+struct MatchNode {
+    uint32_t edges;       // this node's first edge
+    uint32_t edgeCount;
+    uint32_t fail;
+    uint32_t dict;        // next node on the fail chain with an out, 0 = none
+    int32_t out;          // pattern ending exactly here, -1 = none
+};
+
+struct MatchPattern {
+    uint32_t len;         // bytes in the key
+    uint32_t words;
+    uint32_t simplerOff;  // into the string pool
+    uint32_t simplerLen;
+    uint32_t level;       // 1 = A1, 2 = A2
+};
+
+class PhraseMatcher {
+public:
+    // a replacement covering words [first, last] of the sentence
+    struct Match {
+        uint32_t first, last;
+        std::string_view simpler;
+        CEFRLevel level;
+    };
+
+    // views of the tables. nodeCount is at least 1
+    struct Tables {
+        const MatchNode* nodes = nullptr;
+        uint32_t nodeCount = 0;
+        const uint32_t* edgeTargets = nullptr;
+        const uint8_t* edgeBytes = nullptr;   // lowercase, ascending within a node
+        uint32_t edgeCount = 0;
+        const MatchPattern* patterns = nullptr;
+        uint32_t patternCount = 0;
+        const char* strings = nullptr;
+        uint32_t stringsSize = 0;
+    };
+
+    // owner is whatever keeps t's storage alive (a PhraseBuilder, a
+    // mapped file), held for as long as the matcher is. anything out of
+    // range in t only loses matches, it's never read past
+    PhraseMatcher(const Tables& t, std::shared_ptr<const void> owner);
+
+    // every entry that matches a run of whole words, before any filtering
+    void candidates(const std::vector<std::string_view>& words, std::vector<Match>& out) const;
+
+    // the entry whose key is exactly word, ignoring ascii case, with the
+    // same entries (inflected forms included) candidates() sees
+    bool find(std::string_view word, std::string_view& simpler, CEFRLevel& level) const;
+
+    // picks leftmost-longest non-overlapping matches among the candidates
+    // that allow(level) accepts. cands has to be in candidates() order
+    template <typename Allow>
+    static void select(const std::vector<Match>& cands, Allow allow, std::vector<Match>& out) {
+        out.clear();
+        // candidates come ordered by last word; for each first word keep
+        // only the longest allowed one, then sweep left to right
+        if (cands.empty()) return;
+        thread_local std::vector<int32_t> best;
+        size_t n = cands.back().last + 1;
+        best.assign(n, -1);
+        for (size_t i = 0; i < cands.size(); i++) {
+            auto& c = cands[i];
+            if (!allow(c.level)) continue;
+            int32_t& b = best[c.first];
+            if (b < 0 || cands[b].last < c.last) b = (int32_t)i;
+        }
+        for (size_t w = 0; w < n;) {
+            if (best[w] < 0) {
+                w++;
+                continue;
+            }
+            out.push_back(cands[best[w]]);
+            w = cands[best[w]].last + 1;
+        }
+    }
+
+    size_t size() const { return t_.patternCount; }
+
+private:
+    static constexpr uint32_t kNoEdge = UINT32_MAX;
+
+    // c lowercase. the goto edge only, kNoEdge if there isn't one
+    uint32_t child(uint32_t s, unsigned char c) const;
+
+    // the automaton's transition: goto if there's an edge, otherwise
+    // down the fail links until there is one or we reach a node with a
+    // full row. the fail chain only ever goes to lower numbers, so it
+    // always gets there
+    uint32_t step(uint32_t s, unsigned char c) const {
+        while (s >= denseNodes_) {
+            uint32_t to = child(s, (unsigned char)asciiLower((char)c));
+            if (to != kNoEdge) return to;
+            uint32_t f = t_.nodes[s].fail;
+            s = f < s ? f : 0;
+        }
+        return dense_[((size_t)s << shift_) + cls_[c]];
+    }
+
+    // the pattern ending at node s, null if none (or it's out of range)
+    const MatchPattern* patternAt(uint32_t s) const;
+
+    Tables t_;
+    std::shared_ptr<const void> owner_;
+    // full rows for nodes [0, denseNodes_), 2^shift_ classes each.
+    // uppercase bytes share their lowercase class, class 0 is every byte
+    // none of those nodes has an edge for, which always leads to the root
+    std::vector<uint32_t> dense_;
+    std::array<uint8_t, 256> cls_{};
+    unsigned shift_ = 0;
+    uint32_t denseNodes_ = 1;
+};
+
+PhraseMatcher::PhraseMatcher(const Tables& t, std::shared_ptr<const void> owner)
+    : t_(t), owner_(std::move(owner)) {
+    constexpr size_t kDenseBytes = 256 << 10;
+    uint32_t n = std::min<uint32_t>(t_.nodeCount, 1024);
+
+    size_t classes = 1;
+    for (uint32_t s = 0; s < n; s++) {
+        const MatchNode& node = t_.nodes[s];
+        if (node.edges > t_.edgeCount || node.edgeCount > t_.edgeCount - node.edges) continue;
+        for (uint32_t k = 0; k < node.edgeCount; k++) {
+            uint8_t c = t_.edgeBytes[node.edges + k];
+            if (!cls_[c] && classes < 256) cls_[c] = (uint8_t)classes++;
+        }
+    }
+    while (((size_t)1 << shift_) < classes) shift_++;
+    n = (uint32_t)std::min<size_t>(n, std::max<size_t>(1, kDenseBytes / (sizeof(uint32_t) << shift_)));
+
+    // row s is its own edges over its fail state's row, which is done
+    // already since fail states come first
+    std::vector<uint8_t> byteOf((size_t)1 << shift_, 0);
+    for (unsigned c = 0; c < 256; c++) byteOf[cls_[c]] = (uint8_t)c;
+    dense_.assign((size_t)n << shift_, 0);
+    for (uint32_t s = 0; s < n; s++) {
+        uint32_t f = t_.nodes[s].fail;
+        bool hasFail = s != 0 && f < s;
+        for (size_t k = 1; k < ((size_t)1 << shift_); k++) {
+            if (!cls_[byteOf[k]]) continue;   // padding
+            uint32_t to = child(s, byteOf[k]);
+            if (to == kNoEdge) to = hasFail ? dense_[((size_t)f << shift_) + k] : 0;
+            dense_[((size_t)s << shift_) + k] = to;
+        }
+    }
+    denseNodes_ = n;
+    for (int c = 'A'; c <= 'Z'; c++) cls_[c] = cls_[c - 'A' + 'a'];
+}
+
+uint32_t PhraseMatcher::child(uint32_t s, unsigned char c) const {
+    const MatchNode& n = t_.nodes[s];
+    if (n.edges > t_.edgeCount || n.edgeCount > t_.edgeCount - n.edges) return kNoEdge;
+    const uint8_t* b = t_.edgeBytes + n.edges;
+    const uint8_t* e = b + n.edgeCount;
+    // lists below the root are mostly a few edges long, so scan those
+    const uint8_t* it = b;
+    if (n.edgeCount > 8) it = std::lower_bound(b, e, c);
+    else while (it < e && *it < c) it++;
+    if (it == e || *it != c) return kNoEdge;
+    uint32_t to = t_.edgeTargets[n.edges + (it - b)];
+    return to > s && to < t_.nodeCount ? to : kNoEdge;
+}
+
+const MatchPattern* PhraseMatcher::patternAt(uint32_t s) const {
+    int32_t out = t_.nodes[s].out;
+    if (out < 0 || (uint32_t)out >= t_.patternCount) return nullptr;
+    const MatchPattern* p = &t_.patterns[out];
+    if (p->simplerOff > t_.stringsSize || p->simplerLen > t_.stringsSize - p->simplerOff) return nullptr;
+    return p;
+}
+
+void PhraseMatcher::candidates(const std::vector<std::string_view>& words,
+                               std::vector<Match>& out) const {
+    out.clear();
+    if (t_.patternCount == 0) return;
+
+    // start offset of each word in the joined stream, kept per thread
+    thread_local std::vector<uint32_t> starts;
+    starts.resize(words.size());
+
+    uint32_t s = 0;
+    uint32_t pos = 0;
+    for (uint32_t k = 0; k < (uint32_t)words.size(); k++) {
+        // punctuation either side ends the word, and no phrase runs
+        // across it ("utilize" in quotes is still a match)
+        auto tok = words[k];
+        size_t b = coreStart(tok);
+        size_t n = std::max(b, coreEnd(tok));
+        if (b > 0) s = 0;
+
+        starts[k] = pos;
+        for (size_t i = b; i < n; i++) s = step(s, (unsigned char)tok[i]);
+        pos += (uint32_t)(n - b);
+
+        // everything ending here, longest first along the dict chain.
+        // a match only counts if it starts where a word starts
+        uint32_t t = t_.nodes[s].out >= 0 ? s : t_.nodes[s].dict;
+        for (uint32_t prev = s + 1; t > 0 && t < prev; prev = t, t = t_.nodes[t].dict) {
+            const MatchPattern* p = patternAt(t);
+            if (!p || p->words > k + 1) continue;
+            uint32_t first = k + 1 - p->words;
+            if (starts[first] + p->len != pos) continue;
+            out.push_back({ first, k, std::string_view(t_.strings + p->simplerOff, p->simplerLen),
+                            p->level == 1 ? CEFRLevel::A1 : CEFRLevel::A2 });
+        }
+
+        if (n < tok.size()) s = 0;
+        else s = step(s, ' ');
+        pos++;
+    }
+}
+
+bool PhraseMatcher::find(std::string_view word, std::string_view& simpler, CEFRLevel& level) const {
+    uint32_t s = 0;
+    for (char c : word) {
+        s = child(s, (unsigned char)asciiLower(c));
+        if (s == kNoEdge) return false;
+    }
+    const MatchPattern* p = s ? patternAt(s) : nullptr;
+    if (!p) return false;
+    simpler = std::string_view(t_.strings + p->simplerOff, p->simplerLen);
+    level = p->level == 1 ? CEFRLevel::A1 : CEFRLevel::A2;
+    return true;
+}
+
+namespace {
+
+// collects entries and lays the automaton out as PhraseMatcher::Tables,
+// for the built-in list at startup and for compile-lexicon
+class PhraseBuilder {
+public:
+    // first add wins, so add the entries that should take priority first.
+    // the key is lowercased with whitespace collapsed to single spaces
+    void add(std::string_view phrase, std::string_view simpler, CEFRLevel level);
+
+    // the -s, -ed and -ing forms of every single word entry so far. a form
+    // that's also an entry of its own (or an earlier entry's form) keeps
+    // that one
+    void addInflections();
+
+    // fills the tables below from everything added
+    void build();
+
+    PhraseMatcher::Tables tables() const;
+
+    std::vector<MatchNode> nodes;
+    std::vector<uint32_t> edgeTargets;
+    std::vector<uint8_t> edgeBytes;
+    std::vector<MatchPattern> patterns;
+    std::string strings;
+
+private:
+    std::unordered_map<std::string, uint32_t> keys_;   // key -> pattern
+    std::vector<const std::string*> order_;           // keys in pattern order
+    std::unordered_map<std::string, uint32_t> pooled_; // replacement -> offset in strings
+};
+
+void PhraseBuilder::add(std::string_view phrase, std::string_view simpler, CEFRLevel level) {
+    std::string key;
+    for (char c : phrase) {
+        if (isSpace(c)) {
+            if (!key.empty() && key.back() != ' ') key += ' ';
+        } else {
+            key += asciiLower(c);
+        }
+    }
+    while (!key.empty() && key.back() == ' ') key.pop_back();
+    if (key.empty()) return;
+    uint32_t len = (uint32_t)key.size();
+    uint32_t words = 1 + (uint32_t)std::count(key.begin(), key.end(), ' ');
+    auto ins = keys_.emplace(std::move(key), (uint32_t)patterns.size());
+    if (!ins.second) return;
+    order_.push_back(&ins.first->first);
+
+    // replacements repeat a lot ("use" and its forms), so each is pooled once
+    auto pooled = pooled_.emplace(std::string(simpler), (uint32_t)strings.size());
+    if (pooled.second) strings += simpler;
+
+    MatchPattern p{};
+    p.len = len;
+    p.words = words;
+    p.simplerOff = pooled.first->second;
+    p.simplerLen = (uint32_t)simpler.size();
+    p.level = level == CEFRLevel::A1 ? 1 : 2;
+    patterns.push_back(p);
+}
+
+void PhraseBuilder::addInflections() {
+    std::string word, simpler;
+    size_t n = order_.size();
+    for (size_t i = 0; i < n; i++) {
+        const MatchPattern p = patterns[i];
+        const std::string& key = *order_[i];
+        std::string base = strings.substr(p.simplerOff, p.simplerLen);
+        if (p.words != 1 || !inflectable(key, base)) continue;
+        for (auto f : { Inflection::S, Inflection::Past, Inflection::Ing }) {
+            if (!inflect(key, f, word) || !inflect(base, f, simpler)) continue;
+            add(word, simpler, p.level == 1 ? CEFRLevel::A1 : CEFRLevel::A2);
+        }
+    }
+}
+
+void PhraseBuilder::build() {
+    // a plain trie first, children as (byte, node) pairs
+    struct TrieNode {
+        std::vector<std::pair<uint8_t, uint32_t>> kids;
+        int32_t out = -1;
+    };
+    std::vector<TrieNode> trie(1);
+    for (size_t i = 0; i < order_.size(); i++) {
+        uint32_t s = 0;
+        for (unsigned char c : *order_[i]) {
+            auto& kids = trie[s].kids;
+            auto it = std::find_if(kids.begin(), kids.end(), [c](const auto& e) { return e.first == c; });
+            if (it != kids.end()) {
+                s = it->second;
+                continue;
+            }
+            uint32_t t = (uint32_t)trie.size();
+            kids.emplace_back(c, t);
+            trie.emplace_back();
+            s = t;
+        }
+        trie[s].out = (int32_t)i;
+    }
+    if (trie.size() > INT32_MAX) throw std::runtime_error("lexicon too big");
+
+    // numbered breadth first, edges sorted by byte
+    std::vector<uint32_t> bfs{ 0 }, id(trie.size());
+    bfs.reserve(trie.size());
+    for (size_t qi = 0; qi < bfs.size(); qi++) {
+        auto& kids = trie[bfs[qi]].kids;
+        std::sort(kids.begin(), kids.end());
+        for (auto& e : kids) bfs.push_back(e.second);
+    }
+    for (uint32_t i = 0; i < (uint32_t)bfs.size(); i++) id[bfs[i]] = i;
+
+    nodes.assign(bfs.size(), MatchNode{});
+    edgeTargets.clear();
+    edgeBytes.clear();
+    for (uint32_t i = 0; i < (uint32_t)bfs.size(); i++) {
+        auto& tn = trie[bfs[i]];
+        MatchNode& n = nodes[i];
+        n.edges = (uint32_t)edgeTargets.size();
+        n.edgeCount = (uint32_t)tn.kids.size();
+        n.out = tn.out;
+        for (auto& e : tn.kids) {
+            edgeBytes.push_back(e.first);
+            edgeTargets.push_back(id[e.second]);
+        }
+    }
+    trie = {};
+
+    // fail links in node order: a node's parent and everything on its
+    // parent's fail chain are shallower, so they're done by the time we
+    // get to it
+    auto child = [&](uint32_t s, uint8_t c) -> uint32_t {
+        auto b = edgeBytes.begin() + nodes[s].edges, e = b + nodes[s].edgeCount;
+        auto it = std::lower_bound(b, e, c);
+        return it != e && *it == c ? edgeTargets[it - edgeBytes.begin()] : 0;
+    };
+    for (uint32_t s = 0; s < (uint32_t)nodes.size(); s++) {
+        for (uint32_t k = 0; k < nodes[s].edgeCount; k++) {
+            uint32_t t = edgeTargets[nodes[s].edges + k];
+            uint8_t c = edgeBytes[nodes[s].edges + k];
+            uint32_t f = 0;
+            if (s != 0) {
+                f = nodes[s].fail;
+                while (true) {
+                    uint32_t to = child(f, c);
+                    if (to) { f = to; break; }
+                    if (f == 0) break;
+                    f = nodes[f].fail;
+                }
+            }
+            nodes[t].fail = f;
+            nodes[t].dict = nodes[f].out >= 0 ? f : nodes[f].dict;
+        }
+    }
+}
+
+PhraseMatcher::Tables PhraseBuilder::tables() const {
+    PhraseMatcher::Tables t;
+    t.nodes = nodes.data();
+    t.nodeCount = (uint32_t)nodes.size();
+    t.edgeTargets = edgeTargets.data();
+    t.edgeBytes = edgeBytes.data();
+    t.edgeCount = (uint32_t)edgeTargets.size();
+    t.patterns = patterns.data();
+    t.patternCount = (uint32_t)patterns.size();
+    t.strings = strings.data();
+    t.stringsSize = (uint32_t)strings.size();
+    return t;
+}
+
+} // namespace
+
+namespace {
+
+// simpler in the case of the word it replaces: "Utilizes" -> "Uses",
+// "UTILIZE" -> "USE", anything else as it is in the lexicon
+void appendInCase(std::pmr::string& out, std::string_view simpler, std::string_view like) {
+    size_t at = out.size();
+    out += simpler;
+    if (like.empty() || like[0] < 'A' || like[0] > 'Z') return;
+    bool allCaps = like.size() > 1 && std::none_of(like.begin(), like.end(), [](char c) { return c >= 'a' && c <= 'z'; });
+    size_t end = allCaps ? out.size() : std::min(out.size(), at + 1);
+    for (size_t i = at; i < end; i++) out[i] = asciiUpper(out[i]);
+}
+
+// the words joined by single spaces, with each picked match's words
+// replaced by its simpler text. the first word's leading and the last
+// word's trailing punctuation are kept
+void appendSwapped(std::pmr::string& out, const std::vector<std::string_view>& toks,
+                   const std::vector<PhraseMatcher::Match>& picked) {
+    size_t m = 0;
+    for (uint32_t k = 0; k < (uint32_t)toks.size(); k++) {
+        if (m < picked.size() && picked[m].first == k) {
+            auto first = toks[k];
+            auto last = toks[picked[m].last];
+            size_t b = coreStart(first);
+            size_t n = coreEnd(last);
+            out.append(first.data(), b);
+            appendInCase(out, picked[m].simpler, first.substr(b));
+            out.append(last.data() + n, last.size() - n);
+            k = picked[m++].last;
+        } else {
+            out += toks[k];
+        }
+        out += ' ';
+    }
+    if (!out.empty()) out.pop_back();
+}
+
+// the built-in list on its own, shared by every vocabulary without a
+// file. it's small and fixed, so it's cheap to build on first use
+std::shared_ptr<const PhraseMatcher> builtinPhrases() {
+    static const auto m = [] {
+        auto b = std::make_shared<PhraseBuilder>();
+        for (auto& e : kLexicon) b->add(e.word, e.simpler, e.level);
+        b->addInflections();
+        b->build();
+        return std::make_shared<const PhraseMatcher>(b->tables(), b);
+    }();
+    return m;
+}
+
+// every vocabulary gets its own number, so anything keyed on one (the
+// result cache) can't mix up two that happen to share an address
+uint64_t nextVocabVersion() {
+    static std::atomic<uint64_t> next{1};
+    return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace
+
+// prebuilt lexicon files, for word lists too big to compile in. the file
+// is the finished automaton, with the built-in list and every inflected
+// form already folded in by compile-lexicon. it's mmapped and matched in
+// place: nothing is parsed, copied or built at load time, so startup
+// cost doesn't grow with the lexicon and untouched pages stay on disk.
+// layout (host byte order, every section 4-byte aligned):
+//
+//   LexFileHeader
+//   MatchNode nodes[nodeCount]             node 0 is the root
+//   uint32_t edgeTargets[edgeCount]
+//   MatchPattern patterns[patternCount]
+//   uint8_t edgeBytes[edgeCount]
+//   char strings[stringsSize]              the replacements
+
+constexpr char kLexMagic[4] = { 'S', 'L', 'E', 'X' };
+constexpr uint32_t kLexVersion = 2;   // 1 was a hash table of base forms
+
+struct LexFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t nodeCount;
+    uint32_t edgeCount;
+    uint32_t patternCount;
+    uint32_t stringsSize;
+    uint32_t nodesOff;
+    uint32_t targetsOff;
+    uint32_t patternsOff;
+    uint32_t bytesOff;
+    uint32_t stringsOff;
+};
+
+class MappedLexicon {
+public:
+    explicit MappedLexicon(const std::string& path) {
+#if defined(_WIN32)
+        std::ifstream in(path, std::ios::binary);
+        if (!in) throw std::runtime_error("can't open lexicon " + path);
+        buf_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        data_ = buf_.data();
+        size_ = buf_.size();
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("can't open lexicon " + path);
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            throw std::runtime_error("can't read lexicon " + path);
+        }
+        size_ = (size_t)st.st_size;
+        void* p = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) throw std::runtime_error("can't map lexicon " + path);
+        data_ = static_cast<const char*>(p);
+#endif
+        // only the header and section bounds are checked here, the matcher
+        // checks what it reads as it goes
+        if (size_ < sizeof(LexFileHeader)) fail(path);
+        hdr_ = reinterpret_cast<const LexFileHeader*>(data_);
+        if (std::memcmp(hdr_->magic, kLexMagic, 4) != 0) fail(path);
+        if (hdr_->version != kLexVersion) {
+            unmap();
+            throw std::runtime_error("lexicon " + path + " is from another version, rebuild it with --compile-lexicon");
+        }
+        if (hdr_->nodeCount == 0 ||
+            !fits(hdr_->nodesOff, (uint64_t)hdr_->nodeCount * sizeof(MatchNode)) ||
+            !fits(hdr_->targetsOff, (uint64_t)hdr_->edgeCount * sizeof(uint32_t)) ||
+            !fits(hdr_->patternsOff, (uint64_t)hdr_->patternCount * sizeof(MatchPattern)) ||
+            !fits(hdr_->bytesOff, hdr_->edgeCount) ||
+            !fits(hdr_->stringsOff, hdr_->stringsSize) ||
+            hdr_->nodesOff % 4 || hdr_->targetsOff % 4 || hdr_->patternsOff % 4)
+            fail(path);
+    }
+
+    ~MappedLexicon() { unmap(); }
+
+    MappedLexicon(const MappedLexicon&) = delete;
+    MappedLexicon& operator=(const MappedLexicon&) = delete;
+
+    // views into the mapping, valid while this is
+    PhraseMatcher::Tables tables() const {
+        PhraseMatcher::Tables t;
+        t.nodes = reinterpret_cast<const MatchNode*>(data_ + hdr_->nodesOff);
+        t.nodeCount = hdr_->nodeCount;
+        t.edgeTargets = reinterpret_cast<const uint32_t*>(data_ + hdr_->targetsOff);
+        t.edgeBytes = reinterpret_cast<const uint8_t*>(data_ + hdr_->bytesOff);
+        t.edgeCount = hdr_->edgeCount;
+        t.patterns = reinterpret_cast<const MatchPattern*>(data_ + hdr_->patternsOff);
+        t.patternCount = hdr_->patternCount;
+        t.strings = data_ + hdr_->stringsOff;
+        t.stringsSize = hdr_->stringsSize;
+        return t;
+    }
+
+private:
+    bool fits(uint64_t off, uint64_t len) const { return off + len <= size_; }
+
+    void unmap() {
+#if !defined(_WIN32)
+        if (data_) ::munmap(const_cast<char*>(data_), size_);
+        data_ = nullptr;
+#endif
+    }
+
+    [[noreturn]] void fail(const std::string& path) {
+        unmap();
+        throw std::runtime_error("not a valid lexicon file: " + path);
+    }
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    const LexFileHeader* hdr_ = nullptr;
+#if defined(_WIN32)
+    std::vector<char> buf_;
+#endif
+};
+
+// turns a word list into the format above. one entry per line:
+//   word <sep> simpler [<sep> level]
+// with tab or comma as the separator and level A1 or A2 (default A1).
+// blank lines and lines starting with # are skipped, a later line for
+// the same word wins. the file's entries take priority over the built-in
+// list, and both get their inflected forms. returns the number of
+// entries written, those included
+size_t compileLexicon(const std::string& inPath, const std::string& outPath) {
+    std::ifstream in(inPath);
+    if (!in) throw std::runtime_error("can't open " + inPath);
+
+    struct Row { std::string word, simpler; CEFRLevel level; };
+    std::vector<Row> rows;
+    std::unordered_map<std::string, size_t> seen;
+
+    auto trim = [](std::string_view v) {
+        while (!v.empty() && isSpace(v.front())) v.remove_prefix(1);
+        while (!v.empty() && isSpace(v.back()))  v.remove_suffix(1);
+        return v;
+    };
+
+    std::string line;
+    int lineNo = 0;
+    while (std::getline(in, line)) {
+        lineNo++;
+        std::string_view v = trim(line);
+        if (v.empty() || v[0] == '#') continue;
+
+        char sep = v.find('\t') != std::string_view::npos ? '\t' : ',';
+        std::string_view fields[3];
+        int nf = 0;
+        while (nf < 3) {
+            auto at = v.find(sep);
+            fields[nf++] = trim(v.substr(0, at));
+            if (at == std::string_view::npos) break;
+            v.remove_prefix(at + 1);
+        }
+        if (nf < 2 || fields[0].empty() || fields[1].empty())
+            throw std::runtime_error(inPath + ":" + std::to_string(lineNo) + ": bad entry");
+
+        CEFRLevel level = CEFRLevel::A1;
+        if (nf == 3 && !fields[2].empty()) {
+            if      (ciEqual(fields[2], "a1")) level = CEFRLevel::A1;
+            else if (ciEqual(fields[2], "a2")) level = CEFRLevel::A2;
+            else throw std::runtime_error(inPath + ":" + std::to_string(lineNo) + ": unknown level");
+        }
+
+        std::string word(fields[0]);
+        for (auto& c : word) c = asciiLower(c);
+        auto it = seen.find(word);
+        if (it != seen.end()) {
+            rows[it->second].simpler = std::string(fields[1]);
+            rows[it->second].level = level;
+            continue;
+        }
+        seen.emplace(word, rows.size());
+        rows.push_back({ std::move(word), std::string(fields[1]), level });
+    }
+
+    PhraseBuilder b;
+    for (auto& r : rows) b.add(r.word, r.simpler, r.level);
+    for (auto& e : kLexicon) b.add(e.word, e.simpler, e.level);
+    b.addInflections();
+    b.build();
+
+    LexFileHeader hdr{};
+    std::memcpy(hdr.magic, kLexMagic, 4);
+    hdr.version      = kLexVersion;
+    hdr.nodeCount    = (uint32_t)b.nodes.size();
+    hdr.edgeCount    = (uint32_t)b.edgeTargets.size();
+    hdr.patternCount = (uint32_t)b.patterns.size();
+    hdr.stringsSize  = (uint32_t)b.strings.size();
+    uint64_t off = sizeof(LexFileHeader);
+    auto place = [&off](uint32_t& at, uint64_t bytes) {
+        at = (uint32_t)off;
+        off += bytes;
+    };
+    place(hdr.nodesOff, b.nodes.size() * sizeof(MatchNode));
+    place(hdr.targetsOff, b.edgeTargets.size() * sizeof(uint32_t));
+    place(hdr.patternsOff, b.patterns.size() * sizeof(MatchPattern));
+    place(hdr.bytesOff, b.edgeBytes.size());
+    place(hdr.stringsOff, b.strings.size());
+    if (off > UINT32_MAX) throw std::runtime_error("lexicon too big: " + inPath);
+
+    std::ofstream out(outPath, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("can't write " + outPath);
+    out.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    out.write(reinterpret_cast<const char*>(b.nodes.data()), b.nodes.size() * sizeof(MatchNode));
+    out.write(reinterpret_cast<const char*>(b.edgeTargets.data()), b.edgeTargets.size() * sizeof(uint32_t));
+    out.write(reinterpret_cast<const char*>(b.patterns.data()), b.patterns.size() * sizeof(MatchPattern));
+    out.write(reinterpret_cast<const char*>(b.edgeBytes.data()), b.edgeBytes.size());
+    out.write(b.strings.data(), b.strings.size());
+    if (!out) throw std::runtime_error("can't write " + outPath);
+    return b.patterns.size();
+}
+
+Vocabulary::Vocabulary(CEFRLevel lvl)
+    : lvl_(lvl), version_(nextVocabVersion()), phrases_(builtinPhrases()) {}
+
+// the file already has the built-in list folded in, under its own
+// entries. the matcher reads the mapping, which ext_ keeps alive
+Vocabulary::Vocabulary(CEFRLevel lvl, const std::string& lexiconPath)
+    : lvl_(lvl), ext_(std::make_shared<const MappedLexicon>(lexiconPath)),
+      version_(nextVocabVersion()), phrases_(std::make_shared<const PhraseMatcher>(ext_->tables(), ext_)) {}
+
+const PhraseMatcher& Vocabulary::phrases() const {
+    return *phrases_;
+}
+
+uint64_t Vocabulary::version() const {
+    return version_;
+}
+
+CEFRLevel Vocabulary::level() const {
+    return lvl_;
+}
+
+// built once per level on first use and never modified after, so any
+// number of simplifiers/threads can read the same one
+std::shared_ptr<const Vocabulary> Vocabulary::shared(CEFRLevel lvl) {
+    if (lvl == CEFRLevel::A1) {
+        static const auto a1 = std::make_shared<const Vocabulary>(CEFRLevel::A1);
+        return a1;
+    }
+    static const auto a2 = std::make_shared<const Vocabulary>(CEFRLevel::A2);
+    return a2;
+}
+
+// the same word tables seen at another level. the lexicon file (if any)
+// stays mapped once for both
+std::shared_ptr<const Vocabulary> Vocabulary::atLevel(CEFRLevel lvl) const {
+    if (!ext_) return shared(lvl);
+    auto v = std::make_shared<Vocabulary>(*this);
+    v->lvl_ = lvl;
+    v->version_ = nextVocabVersion();
+    return v;
+}
+
+// true if both read the same tables, so one lookup can serve both levels
+bool Vocabulary::sharesTables(const Vocabulary& other) const {
+    return ext_ == other.ext_;
+}
+
+// A2 gets every swap, A1 only the A1 ones
+bool Vocabulary::allows(CEFRLevel entryLevel) const {
+    return lvl_ != CEFRLevel::A1 || entryLevel == CEFRLevel::A1;
+}
+
+// like lookup() but whatever the level, which comes back in level. an
+// entry in the file hides a built-in one even when it's filtered out
+std::string_view Vocabulary::lookupAny(std::string_view word, CEFRLevel& level) const {
+    std::string_view simpler;
+    return phrases_->find(word, simpler, level) ? simpler : std::string_view();
+}
+
+// empty view if there's nothing simpler. the same entries the swaps use,
+// inflected forms included ("utilizes" -> "uses"), but only an exact key
+// and in the lexicon's own spelling whatever the case of word;
+// getSimplerWord() is the one that finds words inside punctuation and
+// puts the case back. the view lives as long as the vocabulary
+std::string_view Vocabulary::lookup(std::string_view word) const {
+    CEFRLevel level = lvl_;
+    auto simpler = lookupAny(word, level);
+    return (simpler.empty() || allows(level)) ? simpler : std::string_view();
+}
+
+// these go through the matcher like swapWords does, so inflected and
+// capitalized forms ("Utilizes") are found too, not just lexicon keys
+bool Vocabulary::isSimple(std::string_view word) const {
+    thread_local std::vector<std::string_view> toks;
+    thread_local std::vector<PhraseMatcher::Match> cands, picked;
+    Tokenizer::words(word, toks);
+    phrases_->candidates(toks, cands);
+    PhraseMatcher::select(cands, [this](CEFRLevel l) { return allows(l); }, picked);
+    return picked.empty();
+}
+
+std::string Vocabulary::getSimplerWord(std::string_view word) const {
+    thread_local std::vector<std::string_view> toks;
+    thread_local std::vector<PhraseMatcher::Match> cands, picked;
+    Tokenizer::words(word, toks);
+    phrases_->candidates(toks, cands);
+    PhraseMatcher::select(cands, [this](CEFRLevel l) { return allows(l); }, picked);
+    if (picked.empty()) return std::string(word);
+    std::pmr::string out;
+    appendSwapped(out, toks, picked);
+    return std::string(out);
+}
+
+// ============================================================
+//  Part of speech
+// ============================================================
+
+// just enough tagging for fixPassive. closed-class words and irregular
+// participles come from a table, everything else is guessed from its
+// shape and suffix. the table is built once and shared, and tagging a
+// word is one hash probe
+
+namespace {
+
+enum class Pos : uint8_t {
+    Other, Det, Poss, Pron, ObjPron, Noun, Proper, Num, Adv,
+    BePast, Be, Participle, Gerund, By, Prep, Conj, Verb,
+    NotAgent,   // nouns that follow "by" without doing anything (by the time, by Monday)
+};
+
+// alt is the past tense of an irregular participle, or the other case
+// of a pronoun
+struct PosEntry {
+    std::string_view word;
+    Pos pos;
+    std::string_view alt;
+};
+
+constexpr PosEntry kPosWords[] = {
+    {"the", Pos::Det, {}},    {"a", Pos::Det, {}},      {"an", Pos::Det, {}},
+    {"this", Pos::Det, {}},   {"that", Pos::Det, {}},   {"these", Pos::Det, {}},
+    {"those", Pos::Det, {}},  {"some", Pos::Det, {}},   {"many", Pos::Det, {}},
+    {"several", Pos::Det, {}},{"every", Pos::Det, {}},  {"each", Pos::Det, {}},
+    {"all", Pos::Det, {}},    {"no", Pos::Det, {}},     {"any", Pos::Det, {}},
+    {"his", Pos::Poss, {}},   {"its", Pos::Poss, {}},   {"their", Pos::Poss, {}},
+    {"our", Pos::Poss, {}},   {"my", Pos::Poss, {}},    {"your", Pos::Poss, {}},
+
+    {"i", Pos::Pron, "me"},   {"he", Pos::Pron, "him"}, {"she", Pos::Pron, "her"},
+    {"we", Pos::Pron, "us"},  {"they", Pos::Pron, "them"},
+    {"it", Pos::Pron, "it"},  {"you", Pos::Pron, "you"},
+    {"me", Pos::ObjPron, "I"},{"him", Pos::ObjPron, "he"},{"her", Pos::ObjPron, "she"},
+    {"us", Pos::ObjPron, "we"},{"them", Pos::ObjPron, "they"},
+
+    {"was", Pos::BePast, {}}, {"were", Pos::BePast, {}},
+    {"is", Pos::Be, {}},      {"are", Pos::Be, {}},     {"am", Pos::Be, {}},
+    {"be", Pos::Be, {}},      {"been", Pos::Be, {}},    {"being", Pos::Be, {}},
+    {"has", Pos::Verb, {}},   {"have", Pos::Verb, {}},  {"had", Pos::Verb, {}},
+    {"will", Pos::Verb, {}},  {"would", Pos::Verb, {}}, {"can", Pos::Verb, {}},
+    {"could", Pos::Verb, {}}, {"should", Pos::Verb, {}},{"may", Pos::Verb, {}},
+    {"might", Pos::Verb, {}}, {"must", Pos::Verb, {}},  {"do", Pos::Verb, {}},
+    {"does", Pos::Verb, {}},  {"did", Pos::Verb, {}},
+    {"not", Pos::Other, {}},  {"never", Pos::Other, {}},
+    {"who", Pos::Other, {}},  {"which", Pos::Other, {}},{"what", Pos::Other, {}},
+    {"where", Pos::Other, {}},{"there", Pos::Other, {}},
+
+    {"by", Pos::By, {}},
+    {"in", Pos::Prep, {}},    {"on", Pos::Prep, {}},    {"at", Pos::Prep, {}},
+    {"of", Pos::Prep, {}},    {"for", Pos::Prep, {}},   {"with", Pos::Prep, {}},
+    {"from", Pos::Prep, {}},  {"to", Pos::Prep, {}},    {"into", Pos::Prep, {}},
+    {"over", Pos::Prep, {}},  {"under", Pos::Prep, {}}, {"after", Pos::Prep, {}},
+    {"before", Pos::Prep, {}},{"during", Pos::Prep, {}},{"about", Pos::Prep, {}},
+    {"through", Pos::Prep, {}},{"between", Pos::Prep, {}},{"without", Pos::Prep, {}},
+    {"against", Pos::Prep, {}},{"until", Pos::Prep, {}},
+    {"and", Pos::Conj, {}},   {"but", Pos::Conj, {}},   {"or", Pos::Conj, {}},
+    {"because", Pos::Conj, {}},{"so", Pos::Conj, {}},   {"while", Pos::Conj, {}},
+    {"although", Pos::Conj, {}},{"if", Pos::Conj, {}},  {"when", Pos::Conj, {}},
+    {"since", Pos::Conj, {}},
+
+    {"also", Pos::Adv, {}},   {"already", Pos::Adv, {}},
+    {"often", Pos::Adv, {}},  {"still", Pos::Adv, {}},  {"just", Pos::Adv, {}},
+    {"only", Pos::Adv, {}},   {"first", Pos::Adv, {}},  {"later", Pos::Adv, {}},
+    {"soon", Pos::Adv, {}},
+
+    {"written", Pos::Participle, "wrote"},  {"taken", Pos::Participle, "took"},
+    {"given", Pos::Participle, "gave"},     {"seen", Pos::Participle, "saw"},
+    {"made", Pos::Participle, "made"},      {"built", Pos::Participle, "built"},
+    {"done", Pos::Participle, "did"},       {"shown", Pos::Participle, "showed"},
+    {"known", Pos::Participle, "knew"},     {"found", Pos::Participle, "found"},
+    {"held", Pos::Participle, "held"},      {"sent", Pos::Participle, "sent"},
+    {"told", Pos::Participle, "told"},      {"paid", Pos::Participle, "paid"},
+    {"bought", Pos::Participle, "bought"},  {"brought", Pos::Participle, "brought"},
+    {"caught", Pos::Participle, "caught"},  {"chosen", Pos::Participle, "chose"},
+    {"driven", Pos::Participle, "drove"},   {"eaten", Pos::Participle, "ate"},
+    {"broken", Pos::Participle, "broke"},   {"spoken", Pos::Participle, "spoke"},
+    {"stolen", Pos::Participle, "stole"},   {"begun", Pos::Participle, "began"},
+    {"drawn", Pos::Participle, "drew"},     {"grown", Pos::Participle, "grew"},
+    {"thrown", Pos::Participle, "threw"},   {"hidden", Pos::Participle, "hid"},
+    {"led", Pos::Participle, "led"},        {"left", Pos::Participle, "left"},
+    {"lost", Pos::Participle, "lost"},      {"kept", Pos::Participle, "kept"},
+    {"won", Pos::Participle, "won"},        {"beaten", Pos::Participle, "beat"},
+    {"hit", Pos::Participle, "hit"},        {"put", Pos::Participle, "put"},
+    {"read", Pos::Participle, "read"},      {"set", Pos::Participle, "set"},
+    {"said", Pos::Participle, "said"},      {"heard", Pos::Participle, "heard"},
+    {"met", Pos::Participle, "met"},        {"sold", Pos::Participle, "sold"},
+    {"taught", Pos::Participle, "taught"},  {"thought", Pos::Participle, "thought"},
+    {"felt", Pos::Participle, "felt"},      {"got", Pos::Participle, "got"},
+    {"gotten", Pos::Participle, "got"},     {"forgotten", Pos::Participle, "forgot"},
+    {"understood", Pos::Participle, "understood"},
+
+    // bare singular nouns (by email, by hand) are ruled out anyway, these
+    // are the ones that get past that
+    {"time", Pos::NotAgent, {}},   {"way", Pos::NotAgent, {}},    {"end", Pos::NotAgent, {}},
+    {"far", Pos::NotAgent, {}},    {"now", Pos::NotAgent, {}},    {"then", Pos::NotAgent, {}},
+    {"monday", Pos::NotAgent, {}}, {"tuesday", Pos::NotAgent, {}},{"wednesday", Pos::NotAgent, {}},
+    {"thursday", Pos::NotAgent, {}},{"friday", Pos::NotAgent, {}},{"saturday", Pos::NotAgent, {}},
+    {"sunday", Pos::NotAgent, {}}, {"january", Pos::NotAgent, {}},{"february", Pos::NotAgent, {}},
+    {"march", Pos::NotAgent, {}},  {"april", Pos::NotAgent, {}},  {"june", Pos::NotAgent, {}},
+    {"july", Pos::NotAgent, {}},   {"august", Pos::NotAgent, {}}, {"september", Pos::NotAgent, {}},
+    {"october", Pos::NotAgent, {}},{"november", Pos::NotAgent, {}},{"december", Pos::NotAgent, {}},
+};
+
+class PosTagger {
+public:
+    struct Tag {
+        Pos pos;
+        std::string_view alt;
+    };
+
+    static const PosTagger& shared() {
+        static const PosTagger t;
+        return t;
+    }
+
+    // word without its trailing punctuation
+    Tag tag(std::string_view w) const {
+        if (w.empty()) return { Pos::Other, {} };
+        uint32_t h = ciHash(w, 0);
+        for (size_t i = h & (kSlots - 1);; i = (i + 1) & (kSlots - 1)) {
+            int16_t e = slot_[i];
+            if (e < 0) break;
+            if (ciEqual(w, kPosWords[e].word)) return { kPosWords[e].pos, kPosWords[e].alt };
+        }
+
+        // not in the table, so go by shape
+        size_t len;
+        uint8_t cls = classAt(w, 0, len);
+        if (cls & kDigit) return { Pos::Num, {} };
+        if (!(cls & kLetter)) return { Pos::Other, {} };
+        if (w.size() > 3 && endsWith(w, "ly")) return { Pos::Adv, {} };
+        if (w.size() > 4 && endsWith(w, "ing")) return { Pos::Gerund, {} };
+        if (w.size() > 3 && endsWith(w, "ed")) return { Pos::Participle, {} };
+        if (isUpperAt(w, 0)) return { Pos::Proper, {} };
+        return { Pos::Noun, {} };
+    }
+
+    // out[i] is words[i]'s tag, tagged without its trailing punctuation
+    void tag(const std::vector<std::string_view>& words, std::vector<Tag>& out) const {
+        out.resize(words.size());
+        for (size_t i = 0; i < words.size(); i++) {
+            auto w = words[i];
+            out[i] = tag(w.substr(0, coreEnd(w)));
+        }
+    }
+
+private:
+    static constexpr size_t kSlots = 512;   // power of two, well over the table size
+    static_assert(sizeof(kPosWords) / sizeof(kPosWords[0]) * 2 <= kSlots, "grow kSlots with kPosWords");
+
+    PosTagger() {
+        slot_.fill(-1);
+        for (size_t e = 0; e < sizeof(kPosWords) / sizeof(kPosWords[0]); e++) {
+            size_t i = ciHash(kPosWords[e].word, 0) & (kSlots - 1);
+            while (slot_[i] >= 0) i = (i + 1) & (kSlots - 1);
+            slot_[i] = (int16_t)e;
+        }
+    }
+
+    std::array<int16_t, kSlots> slot_;
+};
+
+} // namespace
+
+// ============================================================
+//  SentenceRewriter
+// ============================================================
+
+SentenceRewriter::SentenceRewriter(CEFRLevel lvl, const Vocabulary& v)
+    : lvl_(lvl), vocab_(v), stripBrackets_(false), stripDashes_(false), stagesKey_(0) {}
+
+// parens are always stripped at A1. these add [brackets] and
+// — em-dash asides — (or -- ascii ones --) on top of that
+void SentenceRewriter::setStripAsides(bool brackets, bool dashes) {
+    stripBrackets_ = brackets;
+    stripDashes_   = dashes;
+}
+
+// everything besides the sentence itself that rewrite() depends on,
+// folded into one number for cache keys
+uint64_t SentenceRewriter::configKey() const {
+    uint64_t k = vocab_.version() << 8 | (uint64_t)lvl_ << 2
+               | (uint64_t)stripBrackets_ << 1 | (uint64_t)stripDashes_;
+    // nothing to tell apart without custom stages, so keys stay the same
+    return stagesKey_ ? k ^ stagesKey_ * 0x9e3779b97f4a7c15ull : k;
+}
+
+CEFRLevel SentenceRewriter::level() const {
+    return lvl_;
+}
+
+// same settings, another level
+SentenceRewriter SentenceRewriter::atLevel(CEFRLevel lvl, const Vocabulary& v) const {
+    SentenceRewriter r(lvl, v);
+    r.setStripAsides(stripBrackets_, stripDashes_);
+    return r;
+}
+
+// same level, settings and custom stages over another vocabulary. v has
+// to outlive the copy
+SentenceRewriter SentenceRewriter::withVocabulary(const Vocabulary& v) const {
+    SentenceRewriter r(lvl_, v);
+    r.setStripAsides(stripBrackets_, stripDashes_);
+    r.stages_ = stages_;
+    r.stagesKey_ = stagesKey_;
+    return r;
+}
+
+namespace {
+
+// true if toks joined by single spaces is s already, which is what
+// appendSwapped would write with nothing picked
+bool joinedBySpaces(std::string_view s, const std::vector<std::string_view>& toks) {
+    if (toks.empty()) return s.empty();
+    if (toks.front().data() != s.data() || toks.back().data() + toks.back().size() != s.data() + s.size())
+        return false;
+    for (size_t i = 1; i < toks.size(); i++) {
+        const char* gap = toks[i - 1].data() + toks[i - 1].size();
+        if (toks[i].data() != gap + 1 || *gap != ' ') return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool SentenceRewriter::swapWords(std::string_view s, std::pmr::string& out) const {
+    // token scratch is kept per thread so it stops growing after warmup
+    thread_local std::vector<std::string_view> toks;
+    Tokenizer::words(s, toks);
+
+    thread_local std::vector<PhraseMatcher::Match> cands, picked;
+    vocab_.phrases().candidates(toks, cands);
+    PhraseMatcher::select(cands, [this](CEFRLevel l) { return vocab_.allows(l); }, picked);
+    if (picked.empty() && joinedBySpaces(s, toks)) return false;
+
+    out.reserve(s.size() + 16);
+    appendSwapped(out, toks, picked);
+    if (!picked.empty()) countStat(&StatBlock::wordsReplaced, picked.size());
+    return true;
+}
+
+// swapWords for this rewriter and other over the same text, one token
+// pass and one lookup per word for both. only valid when the two
+// vocabularies share their tables
+std::pair<bool, bool>
+SentenceRewriter::swapPair(std::string_view s, const SentenceRewriter& other,
+                           std::pmr::string& mine, std::pmr::string& theirs) const {
+    thread_local std::vector<std::string_view> toks;
+    Tokenizer::words(s, toks);
+    bool joined = joinedBySpaces(s, toks);
+
+    // one automaton pass, then each level picks from the same candidates
+    thread_local std::vector<PhraseMatcher::Match> cands, picked;
+    vocab_.phrases().candidates(toks, cands);
+
+    std::pair<bool, bool> changed;
+    size_t replaced = 0;
+    PhraseMatcher::select(cands, [this](CEFRLevel l) { return vocab_.allows(l); }, picked);
+    if ((changed.first = !picked.empty() || !joined)) {
+        mine.reserve(s.size() + 16);
+        appendSwapped(mine, toks, picked);
+        replaced += picked.size();
+    }
+    PhraseMatcher::select(cands, [&other](CEFRLevel l) { return other.vocab_.allows(l); }, picked);
+    if ((changed.second = !picked.empty() || !joined)) {
+        theirs.reserve(s.size() + 16);
+        appendSwapped(theirs, toks, picked);
+        replaced += picked.size();
+    }
+    if (replaced) countStat(&StatBlock::wordsReplaced, replaced);
+    return changed;
+}
+
+namespace {
+
+// words a long sentence can be broken in front of. lead is put in front
+// of the new sentence, and keep says whether the word itself stays
+// ("because" -> "this is because ...", "whereas" -> "but ...")
+struct ClauseWord {
+    std::string_view word, lead;
+    bool keep;
+    bool afterComma;   // only when the previous word ends in a comma
+    bool needsSubject; // only when the next word looks like one, so
+                       // "slow and expensive" stays together
+};
+
+constexpr ClauseWord kClauseWords[] = {
+    {"and",      "",         false, false, true},
+    {"but",      "",         true,  false, true},
+    {"because",  "this is ", true,  false, false},
+    {"although", "but ",     false, false, false},
+    {"whereas",  "but ",     false, false, false},
+    // ", which ..." at the end of a sentence is about all of it
+    {"which",    "this ",    false, true,  false},
+};
+
+// pronouns and determiners, what a new clause usually starts with
+constexpr std::string_view kSubjectStarts[] = {
+    "a", "an", "he", "i", "it", "its", "our", "she", "that", "the", "their",
+    "there", "these", "they", "this", "those", "we", "you",
+};
+
+bool startsSubject(std::string_view w) {
+    for (auto sw : kSubjectStarts)
+        if (ciEqual(w, sw)) return true;
+    return false;
+}
+
+// bit n set if some clause word has n letters / starts with the n-th
+// letter, so almost every word is ruled out without comparing anything
+constexpr uint32_t clauseLengths() {
+    uint32_t m = 0;
+    for (auto& c : kClauseWords) m |= 1u << c.word.size();
+    return m;
+}
+constexpr uint32_t clauseInitials() {
+    uint32_t m = 0;
+    for (auto& c : kClauseWords) m |= 1u << (c.word[0] - 'a');
+    return m;
+}
+constexpr uint32_t kClauseLengths = clauseLengths();
+constexpr uint32_t kClauseInitials = clauseInitials();
+
+const ClauseWord* findClauseWord(std::string_view w) {
+    if (w.size() >= 32 || !(kClauseLengths >> w.size() & 1)) return nullptr;
+    unsigned initial = (unsigned)(asciiLower(w[0]) - 'a');
+    if (initial >= 26 || !(kClauseInitials >> initial & 1)) return nullptr;
+    for (auto& c : kClauseWords)
+        if (ciEqual(w, c.word)) return &c;
+    return nullptr;
+}
+
+// a piece of the sentence as offsets into it, with lead in front
+struct Clause {
+    uint32_t begin, end;
+    std::string_view lead;
+};
+
+// neither side of a break gets fewer words than this
+constexpr size_t kMinClause = 3;
+
+// the offset just past w, less a trailing comma or semicolon
+uint32_t clauseEnd(std::string_view s, std::string_view w) {
+    size_t n = w.size();
+    if (n > 1 && (w[n - 1] == ',' || w[n - 1] == ';')) n--;
+    return (uint32_t)(w.data() + n - s.data());
+}
+
+// breaks at every semicolon, and at a clause word once the current piece
+// has at least half the limit in words. words has to be a tokenization
+// of s. one pass over the words, nothing copied
+void findClauses(std::string_view s, const std::vector<std::string_view>& words, size_t limit,
+                 std::vector<Clause>& out) {
+    out.clear();
+    if (words.empty()) return;
+    auto offset = [&](std::string_view w) { return (uint32_t)(w.data() - s.data()); };
+
+    Clause cur{ offset(words[0]), 0, {} };
+    size_t first = 0;
+    for (size_t i = 0; i < words.size(); i++) {
+        auto w = words[i];
+        size_t have = i - first, left = words.size() - i;
+
+        if (i > first && have >= limit / 2) {
+            const ClauseWord* c = findClauseWord(w);
+            // a ", which" clause is only split off if it runs to the end
+            if (c && c->afterComma &&
+                (words[i - 1].back() != ',' ||
+                 std::any_of(words.begin() + i, words.end(), [](std::string_view x) { return x.back() == ','; })))
+                c = nullptr;
+            if (c && c->needsSubject && (i + 1 == words.size() || !startsSubject(words[i + 1]))) c = nullptr;
+            if (c && left - (c->keep ? 0 : 1) >= kMinClause) {
+                cur.end = clauseEnd(s, words[i - 1]);
+                out.push_back(cur);
+                first = c->keep ? i : i + 1;
+                cur = { offset(words[first]), 0, c->lead };
+                continue;
+            }
+        }
+
+        if (w.back() == ';' && have + 1 >= kMinClause && left - 1 >= kMinClause) {
+            cur.end = clauseEnd(s, w);
+            out.push_back(cur);
+            first = i + 1;
+            cur = { offset(words[first]), 0, {} };
+        }
+    }
+    cur.end = offset(words.back()) + (uint32_t)words.back().size();
+    out.push_back(cur);
+}
+
+} // namespace
+
+RewriteParts SentenceRewriter::trySplit(std::string_view s, std::pmr::memory_resource* mr) const {
+    // split anything over ~10 words (A1) or ~15 words (A2)
+    size_t limit = (lvl_ == CEFRLevel::A1) ? 10 : 15;
+
+    thread_local std::vector<std::string_view> words;
+    Tokenizer::words(s, words);
+
+    RewriteParts chunks(mr);
+    if (words.size() <= limit) {
+        chunks.emplace_back(s);
+        return chunks;
+    }
+
+    // the break points are worked out as offsets first, so the only
+    // strings made are the parts themselves
+    thread_local std::vector<Clause> clauses;
+    findClauses(s, words, limit, clauses);
+    chunks.reserve(clauses.size());
+    for (auto& c : clauses) {
+        auto& part = chunks.emplace_back();
+        part.reserve(c.lead.size() + (c.end - c.begin));
+        part.append(c.lead);
+        part.append(s.substr(c.begin, c.end - c.begin));
+    }
+    return chunks;
+}
+
+bool SentenceRewriter::stripParens(std::string_view s, std::pmr::string& out) const {
+    // only strip for A1, A2 readers can probably handle it
+    if (lvl_ != CEFRLevel::A1) return false;
+
+    static const std::string_view emDash = "\u2014";
+
+    // nothing that could open an aside, which is most sentences
+    if (s.find('(') == std::string_view::npos &&
+        !(stripBrackets_ && s.find('[') != std::string_view::npos) &&
+        !(stripDashes_ && (s.find("--") != std::string_view::npos || s.find(emDash) != std::string_view::npos)))
+        return false;
+
+    // single pass, nesting handled with a depth counter. an opener that
+    // never closes is left alone along with everything after it
+    out.reserve(s.size());
+    int depth = 0;
+    size_t openAt = 0;
+    for (size_t i = 0; i < s.size(); i++) {
+        char c = s[i];
+        bool opener = c == '(' || (stripBrackets_ && c == '[');
+        bool closer = c == ')' || (stripBrackets_ && c == ']');
+
+        if (opener) {
+            if (depth++ == 0) openAt = i;
+            continue;
+        }
+        if (depth > 0) {
+            if (closer) depth--;
+            continue;
+        }
+
+        if (stripDashes_) {
+            size_t dashLen = 0;
+            if (s.compare(i, emDash.size(), emDash) == 0) dashLen = emDash.size();
+            else if (s.compare(i, 2, "--") == 0)         dashLen = 2;
+            if (dashLen) {
+                // only paired dashes are an aside, a lone one stays
+                auto close = s.find(s.substr(i, dashLen), i + dashLen);
+                if (close != std::string_view::npos) {
+                    i = close + dashLen - 1;
+                    continue;
+                }
+            }
+        }
+
+        out += c;
+    }
+    if (depth > 0) out.append(s.substr(openAt));
+    // only ever drops bytes, so the same length means nothing went
+    return out.size() != s.size();
+}
+
+namespace {
+
+bool nounish(Pos p) {
+    return p == Pos::Noun || p == Pos::Proper || p == Pos::Num;
+}
+
+// words in front of a noun in a noun phrase ("the newly trained model")
+bool modifier(Pos p) {
+    return nounish(p) || p == Pos::Participle || p == Pos::Gerund || p == Pos::Adv;
+}
+
+// w less its trailing punctuation
+std::string_view wordCore(std::string_view w) {
+    return w.substr(0, coreEnd(w));
+}
+
+// punctuation that ends a phrase, the period in "Dr." doesn't
+bool trailingPunct(std::string_view w) {
+    if (coreEnd(w) == w.size()) return false;
+    return !(w.back() == '.' && isAbbreviation(wordCore(w)));
+}
+
+// start of the subject that ends right before words[end], or npos. it
+// has to be the start of the sentence or follow a comma, so clauses
+// like "the results of the study were" are left alone
+size_t subjectBefore(const std::vector<std::string_view>& words,
+                     const std::vector<PosTagger::Tag>& tags, size_t end) {
+    constexpr size_t kMaxWords = 6;
+    if (end == 0 || trailingPunct(words[end - 1])) return std::string_view::npos;
+    size_t start = end - 1;
+    Pos head = tags[start].pos;
+    if (head != Pos::Pron) {
+        if (!nounish(head)) return std::string_view::npos;
+        while (start > 0 && end - start < kMaxWords && !trailingPunct(words[start - 1])) {
+            Pos p = tags[start - 1].pos;
+            if (p == Pos::Det || p == Pos::Poss) {
+                start--;
+                break;
+            }
+            if (!modifier(p)) break;
+            start--;
+        }
+    }
+    if (start > 0 && words[start - 1].back() != ',') return std::string_view::npos;
+    return start;
+}
+
+// whether words[k] carries on the agent that ends right before it: "and
+// his friend", "or Mary", "of Rome", "who lived next door". moving the
+// agent would leave that part behind the object, so these aren't touched.
+// "it was reported by officials that ..." has no real subject either
+bool agentGoesOn(const std::vector<std::string_view>& words,
+                 const std::vector<PosTagger::Tag>& tags, size_t k) {
+    if (k == 0 || k >= words.size() || trailingPunct(words[k - 1])) return false;
+    if (tags[k].pos == Pos::Conj) return true;
+    auto w = wordCore(words[k]);
+    return ciEqual(w, "of") || ciEqual(w, "who") || ciEqual(w, "which") || ciEqual(w, "that");
+}
+
+// one past the agent starting at words[at], or 0 if what follows "by"
+// doesn't look like someone doing something
+size_t agentAfter(const std::vector<std::string_view>& words,
+                  const std::vector<PosTagger::Tag>& tags, size_t at) {
+    constexpr size_t kMaxWords = 5;
+    size_t n = words.size();
+    if (at >= n) return 0;
+    Pos first = tags[at].pos;
+
+    if (agentGoesOn(words, tags, at + 1)) return 0;
+
+    // "by her" is a pronoun, "by her team" isn't
+    bool herTeam = first == Pos::ObjPron && ciEqual(wordCore(words[at]), "her") && at + 1 < n &&
+                   !trailingPunct(words[at]) && nounish(tags[at + 1].pos);
+    if ((first == Pos::ObjPron || first == Pos::Pron) && !herTeam) return at + 1;
+
+    size_t k = at;
+    bool det = first == Pos::Det || first == Pos::Poss || herTeam;
+    if (det) {
+        if (trailingPunct(words[k])) return 0;
+        k++;
+    }
+    size_t nouns = k;
+    while (k < n && k - nouns < kMaxWords && modifier(tags[k].pos)) {
+        if (trailingPunct(words[k++])) break;
+    }
+    if (k == nouns || !nounish(tags[k - 1].pos)) return 0;
+    for (size_t i = nouns; i < k; i++)
+        if (tags[i].pos == Pos::NotAgent) return 0;
+    if (agentGoesOn(words, tags, k)) return 0;
+    if (det) return k;
+
+    // bare nouns: names ("by John") and plurals ("by scientists") but not
+    // "by email" or "by 2010"
+    auto head = wordCore(words[k - 1]);
+    if (tags[nouns].pos == Pos::Proper) return k;
+    if (tags[k - 1].pos == Pos::Noun && endsWith(head, "s") && !endsWith(head, "ss")) return k;
+    return 0;
+}
+
+} // namespace
+
+// "the ball was kicked by John" -> "John kicked the ball". only simple
+// past passives with an agent at the front of the sentence (or after a
+// comma) are turned around, anything the tagger isn't sure of is left
+// as it was. one tag lookup per word, and the scratch is kept per thread
+bool SentenceRewriter::fixPassive(std::string_view s, std::pmr::string& out) const {
+    // most sentences aren't passive at all, so check before tagging
+    if (s.find(" by ") == std::string_view::npos ||
+        (s.find("was ") == std::string_view::npos && s.find("were ") == std::string_view::npos))
+        return false;
+
+    thread_local std::vector<std::string_view> words;
+    thread_local std::vector<PosTagger::Tag> tags;
+    Tokenizer::words(s, words);
+    PosTagger::shared().tag(words, tags);
+
+    size_t n = words.size();
+    for (size_t be = 1; be + 3 < n; be++) {
+        if (tags[be].pos != Pos::BePast || trailingPunct(words[be])) continue;
+        size_t verb = be + 1;
+        bool adverb = tags[verb].pos == Pos::Adv && !trailingPunct(words[verb]);
+        if (adverb) verb++;
+        if (verb + 2 >= n || tags[verb].pos != Pos::Participle || trailingPunct(words[verb]) ||
+            tags[verb + 1].pos != Pos::By || trailingPunct(words[verb + 1]))
+            continue;
+
+        size_t subj = subjectBefore(words, tags, be);
+        if (subj == std::string_view::npos) continue;
+        size_t agent = verb + 2;
+        size_t agentEnd = agentAfter(words, tags, agent);
+        if (!agentEnd) continue;
+
+        out.reserve(s.size() + 8);
+        auto put = [&out](std::string_view w) {
+            if (!out.empty()) out += ' ';
+            out += w;
+        };
+        // a determiner or pronoun that moves off the front of the sentence
+        // goes lowercase. names keep their capital
+        auto putMoved = [&](size_t i, std::string_view w) {
+            size_t at = out.size() + (out.empty() ? 0 : 1);
+            put(w);
+            Pos p = tags[i].pos;
+            if ((p == Pos::Det || p == Pos::Poss || p == Pos::Pron || p == Pos::ObjPron) && w != "I")
+                recaseAt(out, at, false);
+        };
+
+        for (size_t i = 0; i < subj; i++) put(words[i]);
+        auto last = words[agentEnd - 1];
+        auto tail = last.substr(wordCore(last).size());
+        if (agentEnd == agent + 1 && (tags[agent].pos == Pos::Pron || tags[agent].pos == Pos::ObjPron)) {
+            putMoved(agent, tags[agent].alt);
+        } else {
+            for (size_t i = agent; i < agentEnd; i++) {
+                auto w = i + 1 == agentEnd ? wordCore(words[i]) : words[i];
+                if (i == agent) putMoved(i, w);
+                else put(w);
+            }
+        }
+        if (adverb) put(words[be + 1]);
+        put(tags[verb].alt.empty() ? words[verb] : tags[verb].alt);
+        if (tags[subj].pos == Pos::Pron) {
+            putMoved(subj, tags[subj].alt);
+        } else {
+            for (size_t i = subj; i < be; i++) {
+                if (i == subj) putMoved(i, words[i]);
+                else put(words[i]);
+            }
+        }
+        out += tail;
+        for (size_t i = agentEnd; i < n; i++) put(words[i]);
+        return true;
+    }
+    return false;
+}
+
+namespace {
+
+// which built-in stages run at which level. rewrite() is instantiated
+// once per level, so a stage that's off here isn't in that level's code
+// at all. split always runs, it's what turns the text into parts
+constexpr bool stageRunsAt(Stage st, CEFRLevel lvl) {
+    return st != kStageStrip || lvl == CEFRLevel::A1;
+}
+
+// the text between stages: either the input itself or whichever of two
+// buffers the last stage that changed anything wrote to. a stage that
+// leaves the text alone costs no copy
+class StageText {
+public:
+    StageText(std::string_view in, std::pmr::memory_resource* mr)
+        : cur_(in), buf_{ std::pmr::string(mr), std::pmr::string(mr) } {}
+
+    std::string_view view() const { return cur_; }
+
+    // stage(text, out) writes the new text to out (which comes in empty)
+    // and returns true, or returns false if it had nothing to change
+    template <typename Fn>
+    void apply(Fn&& stage) {
+        if (stage(cur_, spare())) commit();
+    }
+
+    // for stages that write two texts at once, apply() in two halves
+    std::pmr::string& spare() {
+        buf_[spare_].clear();
+        return buf_[spare_];
+    }
+    void commit() {
+        cur_ = buf_[spare_];
+        spare_ ^= 1;
+    }
+
+private:
+    std::string_view cur_;
+    std::pmr::string buf_[2];
+    int spare_ = 0;
+};
+
+} // namespace
+
+// custom stages run after the built-in ones and before the split, in the
+// order they were added. a stage is called from whichever thread is
+// rewriting, so it has to be safe to call concurrently
+void SentenceRewriter::addStage(RewriteStage stage) {
+    static std::atomic<uint64_t> next{1};
+    stages_.push_back(std::move(stage));
+    stagesKey_ = stagesKey_ * 31 + next.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <CEFRLevel L>
+RewriteParts SentenceRewriter::rewriteAt(std::string_view sentence, std::pmr::memory_resource* mr) const {
+    StageText s(sentence, mr);
+    StageTimer timer(kStageStrip);
+    if constexpr (stageRunsAt(kStageStrip, L))
+        s.apply([this](std::string_view in, std::pmr::string& out) { return stripParens(in, out); });
+    timer.lap(kStageStrip);
+    if constexpr (stageRunsAt(kStageSwap, L))
+        s.apply([this](std::string_view in, std::pmr::string& out) { return swapWords(in, out); });
+    timer.lap(kStageSwap);
+    if constexpr (stageRunsAt(kStagePassive, L))
+        s.apply([this](std::string_view in, std::pmr::string& out) { return fixPassive(in, out); });
+    timer.lap(kStagePassive);
+    for (auto& st : stages_) s.apply(st);
+    timer.lap(kStageCustom);
+    auto parts = trySplit(s.view(), mr);
+    timer.lap(kStageSplit);
+    if (parts.size() > 1) countStat(&StatBlock::sentencesSplit, 1);
+    return parts;
+}
+
+// every intermediate string, and the parts handed back, come out of mr.
+// pass a per-document arena and the whole lot goes away in one release
+RewriteParts SentenceRewriter::rewrite(std::string_view sentence, std::pmr::memory_resource* mr) const {
+    return lvl_ == CEFRLevel::A1 ? rewriteAt<CEFRLevel::A1>(sentence, mr)
+                                 : rewriteAt<CEFRLevel::A2>(sentence, mr);
+}
+
+// rewrite() for this rewriter and other, the same as two separate calls.
+// when aside stripping leaves both with the same text (most sentences)
+// the word pass is shared
+std::pair<RewriteParts, RewriteParts>
+SentenceRewriter::rewritePair(const SentenceRewriter& other, std::string_view sentence,
+                              std::pmr::memory_resource* mr) const {
+    if (!vocab_.sharesTables(other.vocab_))
+        return { rewrite(sentence, mr), other.rewrite(sentence, mr) };
+
+    StageText a(sentence, mr), b(sentence, mr);
+    StageTimer timer(kStageStrip);
+    if (stageRunsAt(kStageStrip, lvl_))
+        a.apply([this](std::string_view in, std::pmr::string& out) { return stripParens(in, out); });
+    if (stageRunsAt(kStageStrip, other.lvl_))
+        b.apply([&other](std::string_view in, std::pmr::string& out) { return other.stripParens(in, out); });
+    timer.lap(kStageStrip);
+    if (a.view() == b.view()) {
+        auto& x = a.spare();
+        auto& y = b.spare();
+        auto changed = swapPair(a.view(), other, x, y);
+        if (changed.first) a.commit();
+        if (changed.second) b.commit();
+    } else {
+        a.apply([this](std::string_view in, std::pmr::string& out) { return swapWords(in, out); });
+        b.apply([&other](std::string_view in, std::pmr::string& out) { return other.swapWords(in, out); });
+    }
+    timer.lap(kStageSwap);
+    a.apply([this](std::string_view in, std::pmr::string& out) { return fixPassive(in, out); });
+    b.apply([&other](std::string_view in, std::pmr::string& out) { return other.fixPassive(in, out); });
+    timer.lap(kStagePassive);
+    for (auto& st : stages_) a.apply(st);
+    for (auto& st : other.stages_) b.apply(st);
+    timer.lap(kStageCustom);
+    auto pa = trySplit(a.view(), mr);
+    auto pb = other.trySplit(b.view(), mr);
+    timer.lap(kStageSplit);
+    countStat(&StatBlock::sentencesSplit, (pa.size() > 1) + (pb.size() > 1));
+    return { std::move(pa), std::move(pb) };
+}
+
+// ============================================================
+//  ThreadPool
+// ============================================================
+
+// plain fifo pool. parallelFor below does the load balancing: every
+// participant pulls the next chunk off a shared atomic counter, so a
+// thread that finishes early just keeps taking work
+
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned n) {
+        for (unsigned i = 0; i < n; i++)
+            workers_.emplace_back([this] { work(); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto& t : workers_) t.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            jobs_.push_back(std::move(job));
+        }
+        cv_.notify_one();
+    }
+
+    unsigned size() const { return (unsigned)workers_.size(); }
+
+    // one pool for the whole process, sized to the machine
+    static ThreadPool& shared() {
+        static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+        return pool;
+    }
+
+private:
+    void work() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lk(mu_);
+                cv_.wait(lk, [this] { return stop_ || !jobs_.empty(); });
+                if (stop_ && jobs_.empty()) return;
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> jobs_;
+    std::mutex mu_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+};
+
+// calls fn(begin, end) over [0, n) in chunks of `grain`, on up to
+// `threads` threads including the caller. the caller only waits for the
+// chunks to be done, not for the helpers to run, so this is fine to call
+// from inside a pool job even when the pool is saturated
+void parallelFor(size_t n, size_t grain, unsigned threads,
+                 const std::function<void(size_t, size_t)>& fn) {
+    grain = std::max<size_t>(1, grain);
+    size_t nChunks = (n + grain - 1) / grain;
+    if (threads <= 1 || nChunks <= 1) {
+        if (n > 0) fn(0, n);
+        return;
+    }
+
+    struct State {
+        const std::function<void(size_t, size_t)>* fn;
+        size_t n, grain, nChunks;
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        std::mutex mu;
+        std::condition_variable cv;
+        std::exception_ptr err;
+    };
+    auto st = std::make_shared<State>();
+    st->fn = &fn;
+    st->n = n;
+    st->grain = grain;
+    st->nChunks = nChunks;
+
+    // fn is only touched after claiming a chunk, and the caller doesn't
+    // return until every claimed chunk is finished
+    auto drain = [](State& s) {
+        size_t c;
+        while ((c = s.next.fetch_add(1)) < s.nChunks) {
+            size_t b = c * s.grain;
+            size_t e = std::min(s.n, b + s.grain);
+            try {
+                (*s.fn)(b, e);
+            } catch (...) {
+                std::lock_guard<std::mutex> lk(s.mu);
+                if (!s.err) s.err = std::current_exception();
+            }
+            if (s.done.fetch_add(1) + 1 == s.nChunks) {
+                std::lock_guard<std::mutex> lk(s.mu);
+                s.cv.notify_all();
+            }
+        }
+    };
+
+    size_t helpers = std::min<size_t>(threads, nChunks) - 1;
+    for (size_t i = 0; i < helpers; i++)
+        ThreadPool::shared().submit([st, drain] { drain(*st); });
+
+    drain(*st);
+
+    std::unique_lock<std::mutex> lk(st->mu);
+    st->cv.wait(lk, [&] { return st->done.load() == st->nChunks; });
+    if (st->err) std::rethrow_exception(st->err);
+}
+
+// ============================================================
+//  RewriteCache
+// ============================================================
+
+namespace {
+
+uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+// 8 bytes a step. only has to spread keys over the shards and buckets,
+// every hit is checked against the stored text anyway
+uint64_t hashBytes(std::string_view s, uint64_t seed) {
+    const uint64_t m = 0x9e3779b97f4a7c15ull;
+    uint64_t h = mix64(seed) ^ (s.size() * m);
+    size_t i = 0;
+    for (; i + 8 <= s.size(); i += 8) {
+        uint64_t w;
+        std::memcpy(&w, s.data() + i, 8);
+        h = (h ^ mix64(w)) * m;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, s.data() + i, s.size() - i);
+    return mix64((h ^ tail) * m);
+}
+
+} // namespace
+
+// one rewritten sentence as it lands in the output (appendPart already
+// applied) plus its "after" counts, which are always filled in
+struct CachedSentence {
+    std::string source;
+    std::string text;
+    int sentences = 0, words = 0, syllables = 0;
+};
+
+struct CachedArticle {
+    std::string source;
+    std::string simplified;
+    bool hasMetrics = false;
+    TextAnalyzer::Metrics before{}, after{};
+};
+
+// hash -> entry, split into shards that each have their own lock so
+// concurrent lookups mostly don't touch the same one. entries are handed
+// out as shared_ptr so evicting one while someone is still copying it out
+// is fine. a shard drops its oldest entry once it's full
+template <typename Entry>
+class ShardedTable {
+public:
+    ShardedTable(size_t capacity, size_t shards)
+        : n_(std::max<size_t>(1, shards)), shards_(new Shard[n_]),
+          perShard_(std::max<size_t>(1, (capacity + n_ - 1) / n_)) {}
+
+    std::shared_ptr<const Entry> find(uint64_t key, std::string_view source) const {
+        Shard& sh = shardFor(key);
+        {
+            std::shared_lock<std::shared_mutex> lk(sh.mu);
+            auto it = sh.map.find(key);
+            if (it != sh.map.end() && it->second->source == source) {
+                sh.hits.fetch_add(1, std::memory_order_relaxed);
+                return it->second;
+            }
+        }
+        sh.misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    // replaces whatever was under key, including a colliding source
+    void put(uint64_t key, std::shared_ptr<const Entry> e) {
+        Shard& sh = shardFor(key);
+        std::unique_lock<std::shared_mutex> lk(sh.mu);
+        auto it = sh.map.find(key);
+        if (it != sh.map.end()) {
+            it->second = std::move(e);
+            return;
+        }
+        while (sh.map.size() >= perShard_ && !sh.order.empty()) {
+            sh.map.erase(sh.order.front());
+            sh.order.pop_front();
+        }
+        sh.map.emplace(key, std::move(e));
+        sh.order.push_back(key);
+    }
+
+    uint64_t hits() const   { return sum(&Shard::hits); }
+    uint64_t misses() const { return sum(&Shard::misses); }
+
+    size_t size() const {
+        size_t total = 0;
+        for (size_t i = 0; i < n_; i++) {
+            std::shared_lock<std::shared_mutex> lk(shards_[i].mu);
+            total += shards_[i].map.size();
+        }
+        return total;
+    }
+
+private:
+    // own cache line each so the counters don't bounce between cores
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mu;
+        std::unordered_map<uint64_t, std::shared_ptr<const Entry>> map;
+        std::deque<uint64_t> order;
+        mutable std::atomic<uint64_t> hits{0}, misses{0};
+    };
+
+    Shard& shardFor(uint64_t key) const { return shards_[(key >> 48) % n_]; }
+
+    uint64_t sum(std::atomic<uint64_t> Shard::*counter) const {
+        uint64_t total = 0;
+        for (size_t i = 0; i < n_; i++)
+            total += (shards_[i].*counter).load(std::memory_order_relaxed);
+        return total;
+    }
+
+    size_t n_;
+    std::unique_ptr<Shard[]> shards_;
+    size_t perShard_;
+};
+
+// optional, shared between any number of simplifiers and threads. feeds
+// repeat a lot of boilerplate ("Reporting by ...", disclaimers) and a
+// rewrite only depends on the sentence, the level, the strip settings
+// and the vocabulary, so the key is a hash of the text seeded with
+// SentenceRewriter::configKey(). the article table catches exact
+// duplicate documents before they're even tokenized
+class RewriteCache {
+public:
+    struct Stats {
+        uint64_t sentenceHits, sentenceMisses;
+        uint64_t articleHits, articleMisses;
+        size_t sentences, articles;
+    };
+
+    explicit RewriteCache(size_t sentenceCapacity = 1 << 16,
+                          size_t articleCapacity = 1 << 10, size_t shards = 16)
+        : sentences(sentenceCapacity, shards), articles(articleCapacity, shards) {}
+
+    RewriteCache(const RewriteCache&) = delete;
+    RewriteCache& operator=(const RewriteCache&) = delete;
+
+    Stats stats() const {
+        return { sentences.hits(), sentences.misses(),
+                 articles.hits(), articles.misses(),
+                 sentences.size(), articles.size() };
+    }
+
+    static uint64_t key(std::string_view text, uint64_t config) {
+        return hashBytes(text, config);
+    }
+
+    ShardedTable<CachedSentence> sentences;
+    ShardedTable<CachedArticle> articles;
+};
+
+// ============================================================
+//  Live vocabulary
+// ============================================================
+
+// a vocabulary that can be replaced while simplifiers are using it, for
+// lexicon updates without a restart. readers pin whatever version is
+// current, use it through plain references and unpin. publishing swaps
+// one pointer; the old version is kept until every reader that could
+// have seen it is gone, then dropped by the next publish() or collect().
+// readers never free anything, so a worker finishing a document never
+// waits on a lock or pays for an munmap. the usual epoch scheme: each thread announces the epoch it started
+// reading in, and a version retired in epoch e is freed once no thread
+// is pinned at e or earlier
+
+struct LiveVersion;
+
+class LiveVocabulary {
+public:
+    explicit LiveVocabulary(std::shared_ptr<const Vocabulary> v);
+
+    LiveVocabulary(const LiveVocabulary&) = delete;
+    LiveVocabulary& operator=(const LiveVocabulary&) = delete;
+
+    // v and its view at the other level become current. readers already
+    // in keep what they pinned. writers take turns, readers never wait.
+    // returns the new generation
+    uint64_t publish(std::shared_ptr<const Vocabulary> v);
+
+    // 1 for the first version, bumped by each publish
+    uint64_t generation() const;
+
+    // the current version, kept alive for as long as the caller holds it.
+    // takes the writers' lock for a moment, so it's for something held
+    // across a whole job rather than a lookup; Reader is the cheap pin
+    std::shared_ptr<const LiveVersion> snapshot() const;
+
+    // frees the retired versions no reader can still be using. publish()
+    // does this too; call it when a retired lexicon shouldn't wait for
+    // the next publish to go (after the workers have drained, say)
+    void collect() const;
+
+    // keeps one version alive while it's in scope: an epoch load, a store
+    // to this thread's slot and a pointer load on the way in, one store
+    // on the way out. no locks, apart from registering the thread's slot
+    // the first time it reads. lookups through at() cost what they would on a
+    // plain Vocabulary. has to be destroyed on the thread that made it,
+    // before live is. nests, and only the outermost one on a thread pins
+    class Reader {
+    public:
+        explicit Reader(const LiveVocabulary& live);
+        ~Reader();
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        const Vocabulary& at(CEFRLevel lvl) const;
+        uint64_t generation() const;
+
+    private:
+        const LiveVersion* v_;
+    };
+
+private:
+    using Retired = std::vector<std::shared_ptr<const LiveVersion>>;
+    void collectLocked(Retired& dead) const;
+
+    std::atomic<const LiveVersion*> cur_;
+    mutable std::mutex mu_;
+    // mu_ held for these two
+    std::shared_ptr<const LiveVersion> current_;
+    mutable std::vector<std::pair<uint64_t, std::shared_ptr<const LiveVersion>>> retired_;
+};
+
+// one published vocabulary, seen at both levels
+struct LiveVersion {
+    std::shared_ptr<const Vocabulary> at[2];
+    uint64_t generation;
+};
+
+namespace {
+
+// per thread. pinned is the epoch the outermost Reader started in, 0
+// while the thread isn't reading. only the owning thread writes it
+struct ReaderSlot {
+    std::atomic<uint64_t> pinned{0};
+    int depth = 0;
+};
+
+// every thread that has read so far, walked by writers. never destroyed,
+// same as the stat registry
+struct ReaderRegistry {
+    std::mutex mu;
+    std::vector<const ReaderSlot*> live;
+};
+
+ReaderRegistry& readerRegistry() {
+    static ReaderRegistry* r = new ReaderRegistry;
+    return *r;
+}
+
+struct LocalSlot {
+    ReaderSlot slot;
+    LocalSlot() {
+        auto& r = readerRegistry();
+        std::lock_guard<std::mutex> lk(r.mu);
+        r.live.push_back(&slot);
+    }
+    ~LocalSlot() {
+        auto& r = readerRegistry();
+        std::lock_guard<std::mutex> lk(r.mu);
+        r.live.erase(std::find(r.live.begin(), r.live.end(), &slot));
+    }
+};
+
+ReaderSlot& readerSlot() {
+    thread_local LocalSlot s;
+    return s.slot;
+}
+
+// shared by every LiveVocabulary and bumped on each publish. starts at 1
+// so 0 can mean not reading
+std::atomic<uint64_t> gReadEpoch{1};
+
+// the earliest epoch any thread is still pinned at
+uint64_t oldestPinned() {
+    auto& r = readerRegistry();
+    std::lock_guard<std::mutex> lk(r.mu);
+    uint64_t oldest = UINT64_MAX;
+    for (auto* s : r.live) {
+        uint64_t p = s->pinned.load();
+        if (p && p < oldest) oldest = p;
+    }
+    return oldest;
+}
+
+std::shared_ptr<const LiveVersion> makeVersion(std::shared_ptr<const Vocabulary> v, uint64_t generation) {
+    if (!v) throw std::runtime_error("no vocabulary to publish");
+    auto ver = std::make_shared<LiveVersion>();
+    auto other = v->level() == CEFRLevel::A1 ? CEFRLevel::A2 : CEFRLevel::A1;
+    ver->at[(int)other] = v->atLevel(other);
+    ver->at[(int)v->level()] = std::move(v);
+    ver->generation = generation;
+    return ver;
+}
+
+} // namespace
+
+LiveVocabulary::LiveVocabulary(std::shared_ptr<const Vocabulary> v)
+    : cur_(nullptr), current_(makeVersion(std::move(v), 1)) {
+    cur_.store(current_.get());
+}
+
+// the swap, the epoch bump and both sides' pin and pointer loads are all
+// seq_cst. so a reader the scan misses pinned after the swap and can
+// only have loaded the new version, and one pinned later than the
+// retired tag read the epoch after the swap too
+uint64_t LiveVocabulary::publish(std::shared_ptr<const Vocabulary> v) {
+    Retired dead;   // declared first so it's freed after mu_ is let go
+    std::lock_guard<std::mutex> lk(mu_);
+    auto next = makeVersion(std::move(v), current_->generation + 1);
+    cur_.store(next.get());
+    retired_.emplace_back(gReadEpoch.fetch_add(1), std::move(current_));
+    current_ = std::move(next);
+    collectLocked(dead);
+    return current_->generation;
+}
+
+uint64_t LiveVocabulary::generation() const {
+    return cur_.load()->generation;
+}
+
+std::shared_ptr<const LiveVersion> LiveVocabulary::snapshot() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return current_;
+}
+
+void LiveVocabulary::collect() const {
+    Retired dead;
+    std::lock_guard<std::mutex> lk(mu_);
+    collectLocked(dead);
+}
+
+// mu_ held. the versions nobody can reach any more move to dead, so the
+// caller frees them without holding up snapshot() or another publish
+void LiveVocabulary::collectLocked(Retired& dead) const {
+    uint64_t oldest = oldestPinned();
+    auto keep = std::stable_partition(retired_.begin(), retired_.end(),
+                                      [oldest](const auto& r) { return r.first >= oldest; });
+    for (auto it = keep; it != retired_.end(); ++it) dead.push_back(std::move(it->second));
+    retired_.erase(keep, retired_.end());
+}
+
+LiveVocabulary::Reader::Reader(const LiveVocabulary& live) {
+    auto& slot = readerSlot();
+    if (slot.depth++ == 0) slot.pinned.store(gReadEpoch.load());
+    v_ = live.cur_.load();
+}
+
+LiveVocabulary::Reader::~Reader() {
+    auto& slot = readerSlot();
+    if (--slot.depth == 0) slot.pinned.store(0, std::memory_order_release);
+}
+
+const Vocabulary& LiveVocabulary::Reader::at(CEFRLevel lvl) const {
+    return *v_->at[(int)lvl];
+}
+
+uint64_t LiveVocabulary::Reader::generation() const {
+    return v_->generation;
+}
+
+// ============================================================
+//  Aligned output
+// ============================================================
+
+// the simplified text plus where every output sentence came from, for
+// tools that show the two side by side. the original is only viewed, so
+// whatever it points into has to outlive this. rows are columns of
+// offsets rather than strings:
+//
+//   output sentence i   simplified[outputEnd[i-1], outputEnd[i])
+//   its source          sentence sourceOf[i]
+//   source sentence j   original[sourceEnd[j-1], sourceEnd[j])
+//
+// with outputEnd[-1] and sourceEnd[-1] taken as 0. a source sentence that
+// rewrites to nothing has no rows, one that gets split has several. an
+// output range ends with the space before the next sentence, the same
+// bytes run() gives; output(i) leaves it off
+
+struct AlignedArticle {
+    std::string_view original;
+    std::string simplified;
+    CEFRLevel level = CEFRLevel::A1;
+    std::vector<uint32_t> sourceEnd;
+    std::vector<uint32_t> outputEnd;
+    std::vector<uint32_t> sourceOf;
+
+    size_t outputs() const { return outputEnd.size(); }
+
+    // output sentence i, without the trailing space
+    std::string_view output(size_t i) const {
+        uint32_t b = i ? outputEnd[i - 1] : 0;
+        uint32_t n = outputEnd[i] - b;
+        if (n && simplified[b + n - 1] == ' ') n--;
+        return std::string_view(simplified).substr(b, n);
+    }
+
+    // the source sentence output i came from, empty when the original
+    // wasn't kept
+    std::string_view sourceFor(size_t i) const {
+        if (original.empty()) return {};
+        uint32_t j = sourceOf[i];
+        uint32_t b = j ? sourceEnd[j - 1] : 0;
+        return original.substr(b, sourceEnd[j] - b);
+    }
+
+    std::string serialize(bool withOriginal) const;
+    static AlignedArticle parse(std::string_view bytes);
+};
+
+// flat form, host byte order and 4-byte aligned like the lexicon files:
+//
+//   AlignedHeader
+//   uint32_t sourceEnd[sources]
+//   uint32_t outputEnd[outputs]
+//   uint32_t sourceOf[outputs]
+//   char simplified[simplifiedSize]
+//   char original[originalSize]        only with withOriginal
+
+namespace {
+
+constexpr char kAlignedMagic[4] = { 'S', 'A', 'L', 'N' };
+constexpr uint32_t kAlignedVersion = 1;
+
+struct AlignedHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t level;
+    uint32_t sources;
+    uint32_t outputs;
+    uint32_t simplifiedSize;
+    uint32_t originalSize;
+    uint32_t hasOriginal;    // an empty original and none at all differ
+};
+
+template <typename T>
+void appendRaw(std::string& out, const T* p, size_t n) {
+    if (n) out.append(reinterpret_cast<const char*>(p), n * sizeof(T));
+}
+
+} // namespace
+
+std::string AlignedArticle::serialize(bool withOriginal) const {
+    AlignedHeader hdr{};
+    std::memcpy(hdr.magic, kAlignedMagic, 4);
+    hdr.version        = kAlignedVersion;
+    hdr.level          = (uint32_t)level;
+    hdr.sources        = (uint32_t)sourceEnd.size();
+    hdr.outputs        = (uint32_t)outputEnd.size();
+    hdr.simplifiedSize = (uint32_t)simplified.size();
+    hdr.originalSize   = withOriginal ? (uint32_t)original.size() : 0;
+    hdr.hasOriginal    = withOriginal;
+
+    std::string out;
+    out.reserve(sizeof(hdr) + 4 * (sourceEnd.size() + 2 * outputEnd.size()) + simplified.size() +
+                hdr.originalSize);
+    appendRaw(out, &hdr, 1);
+    appendRaw(out, sourceEnd.data(), sourceEnd.size());
+    appendRaw(out, outputEnd.data(), outputEnd.size());
+    appendRaw(out, sourceOf.data(), sourceOf.size());
+    out += simplified;
+    if (withOriginal) out.append(original.data(), original.size());
+    return out;
+}
+
+// the original comes back as a view into bytes (empty if it wasn't
+// kept). everything is checked, so a truncated or corrupt buffer throws
+// instead of handing out offsets past the end
+AlignedArticle AlignedArticle::parse(std::string_view bytes) {
+    auto fail = [] { throw std::runtime_error("not an aligned article"); };
+    AlignedHeader hdr;
+    if (bytes.size() < sizeof(hdr)) fail();
+    std::memcpy(&hdr, bytes.data(), sizeof(hdr));
+    if (std::memcmp(hdr.magic, kAlignedMagic, 4) != 0 || hdr.version != kAlignedVersion ||
+        hdr.level > (uint32_t)CEFRLevel::A2)
+        fail();
+    uint64_t need = sizeof(hdr) + 4 * ((uint64_t)hdr.sources + 2 * (uint64_t)hdr.outputs) +
+                    hdr.simplifiedSize + hdr.originalSize;
+    if (bytes.size() != need) fail();
+
+    AlignedArticle a;
+    a.level = (CEFRLevel)hdr.level;
+    size_t at = sizeof(hdr);
+    auto column = [&](std::vector<uint32_t>& v, uint32_t n) {
+        v.resize(n);
+        if (n) std::memcpy(v.data(), bytes.data() + at, n * sizeof(uint32_t));
+        at += n * sizeof(uint32_t);
+    };
+    column(a.sourceEnd, hdr.sources);
+    column(a.outputEnd, hdr.outputs);
+    column(a.sourceOf, hdr.outputs);
+    a.simplified.assign(bytes.data() + at, hdr.simplifiedSize);
+    at += hdr.simplifiedSize;
+    if (hdr.hasOriginal) a.original = bytes.substr(at, hdr.originalSize);
+
+    // offsets have to be in order and in range for the accessors to be safe
+    auto ordered = [](const std::vector<uint32_t>& v, uint64_t limit) {
+        return std::is_sorted(v.begin(), v.end()) && (v.empty() || v.back() <= limit);
+    };
+    if (!ordered(a.outputEnd, a.simplified.size())) fail();
+    if (!ordered(a.sourceEnd, hdr.hasOriginal ? a.original.size() : UINT32_MAX)) fail();
+    for (auto j : a.sourceOf)
+        if (j >= hdr.sources) fail();
+    return a;
+}
+
+// ============================================================
+//  Simplifier
+// ============================================================
+
+// polled alternative to a progress callback. run() resets both at the
+// start and then bumps done once per sentence, from whichever thread did
+// it. total is the sentence count of the current document. it follows
+// one run at a time: runs that overlap on the same Simplifier (run()
+// from several threads, async jobs in flight together) all reset and
+// bump the same two fields, so give each of those its own Simplifier if
+// the numbers matter
+struct ProgressCounter {
+    std::atomic<int> done{0};
+    std::atomic<int> total{0};
+};
+
+Simplifier::Simplifier(CEFRLevel lvl)
+    : Simplifier(lvl, Vocabulary::shared(lvl)) {}
+
+Simplifier::Simplifier(CEFRLevel lvl, std::shared_ptr<const Vocabulary> vocab)
+    : lvl_(lvl), vocab_(std::move(vocab)), rewriter_(lvl, *vocab_),
+      altVocab_(vocab_->atLevel(lvl == CEFRLevel::A1 ? CEFRLevel::A2 : CEFRLevel::A1)),
+      altRewriter_(rewriter_.atLevel(altVocab_->level(), *altVocab_)),
+      progressFn_(nullptr), progressEvery_(0), progressCounter_(nullptr), threads_(1) {}
+
+// every run reads whatever version of live is current when it starts and
+// keeps it to the end, so a publish never lands mid-document. streams
+// and async jobs do the same through bind(), holding the version they
+// started on until they're done. only simplifySentence on its own picks
+// a publish up between calls. the fixed rewriters only hold the settings
+// and stages here
+Simplifier::Simplifier(CEFRLevel lvl, std::shared_ptr<const LiveVocabulary> live)
+    : Simplifier(lvl, Vocabulary::shared(lvl)) {
+    if (!live) throw std::runtime_error("no live vocabulary");
+    live_ = std::move(live);
+}
+
+// fn gets called at most once per `every` (0 = as often as it can) and
+// always once at the end with (total, total). it runs on whichever
+// worker happens to notice the interval has passed, and a worker that
+// finds another one inside fn just carries on instead of waiting
+void Simplifier::setProgress(std::function<void(int, int)> fn, std::chrono::milliseconds every) {
+    progressFn_ = std::move(fn);
+    progressEvery_ = every;
+}
+
+// counter has to outlive every run that uses it, and only makes sense
+// for one run at a time (see ProgressCounter). null to stop
+void Simplifier::setProgressCounter(ProgressCounter* counter) {
+    progressCounter_ = counter;
+}
+
+// 1 = rewrite on the calling thread (default), 0 = one per core.
+// output order doesn't depend on this
+void Simplifier::setThreads(unsigned n) {
+    threads_ = n ? n : std::max(1u, std::thread::hardware_concurrency());
+}
+
+void Simplifier::setStripAsides(bool brackets, bool dashes) {
+    rewriter_.setStripAsides(brackets, dashes);
+    altRewriter_.setStripAsides(brackets, dashes);
+}
+
+// a stage of your own for output at lvl, see SentenceRewriter::addStage.
+// add it once per level it should run at
+void Simplifier::addStage(CEFRLevel lvl, RewriteStage stage) {
+    (rewriter_.level() == lvl ? rewriter_ : altRewriter_).addStage(std::move(stage));
+}
+
+// null turns caching off (the default). results are the same either way
+void Simplifier::setCache(std::shared_ptr<RewriteCache> cache) {
+    cache_ = std::move(cache);
+}
+
+std::vector<std::string_view> Simplifier::splitSentences(std::string_view text) const {
+    auto tt = Tokenizer::tokenize(text, false);
+    return { tt.sentences.begin(), tt.sentences.end() };
+}
+
+namespace {
+
+// where p's text starts after its leading whitespace, p.size() if it's
+// all blank. what appendPart drops, so counts taken from parts match it
+size_t partStart(std::string_view p) {
+    size_t start = 0;
+    while (size_t sp = start < p.size() ? spaceAt(p, start) : 0) start += sp;
+    return start;
+}
+
+// appends one rewritten part as a sentence of the output: leading
+// whitespace dropped, first letter capitalized (after any opening quote)
+// and a period added if it doesn't end in one. all done in place in out,
+// so as long as out has room this doesn't allocate
+void appendPart(std::string& out, std::string_view p) {
+    size_t start = partStart(p);
+    if (start == p.size()) return;
+    p.remove_prefix(start);
+
+    size_t at = out.size();
+    out.append(p.data(), p.size());
+    size_t first = coreStart(p);
+    if (first < p.size()) recaseAt(out, at + first, true);
+    if (!terminated(p)) out += '.';
+    out += ' ';
+}
+
+// what appendPart can add on top of the part itself
+constexpr size_t kPartOverhead = 2;
+
+// how many levels runLevels can produce at once, one per CEFRLevel
+constexpr int kMaxLevels = 2;
+
+// the rewriters a call goes through: the ones given, or with a live
+// vocabulary, copies of them over the version pinned for the call
+struct BoundRewriters {
+    std::optional<LiveVocabulary::Reader> reader;
+    std::optional<SentenceRewriter> bound[kMaxLevels];
+    const SentenceRewriter* rws[kMaxLevels];
+
+    BoundRewriters(const LiveVocabulary* live, const SentenceRewriter* const* given, size_t n) {
+        std::copy(given, given + n, rws);
+        if (!live) return;
+        reader.emplace(*live);
+        for (size_t k = 0; k < n; k++)
+            rws[k] = &bound[k].emplace(given[k]->withVocabulary(reader->at(given[k]->level())));
+    }
+};
+
+} // namespace
+
+// the cached form of one sentence, rewritten and added on a miss. two
+// threads missing on the same sentence both rewrite it, which is cheaper
+// than making one wait for the other
+std::shared_ptr<const CachedSentence>
+Simplifier::rewriteCached(const SentenceRewriter& rw, std::string_view sentence,
+                          std::pmr::memory_resource* mr) const {
+    uint64_t key = RewriteCache::key(sentence, rw.configKey());
+    if (auto hit = cache_->sentences.find(key, sentence)) return hit;
+
+    auto e = std::make_shared<CachedSentence>();
+    e->source.assign(sentence.data(), sentence.size());
+    auto parts = rw.rewrite(sentence, mr);
+    size_t need = 0;
+    for (auto& p : parts) need += p.size() + kPartOverhead;
+    e->text.reserve(need);
+
+    thread_local std::vector<std::string_view> toks;
+    for (auto& p : parts) {
+        size_t at = e->text.size();
+        appendPart(e->text, p);
+        if (e->text.size() == at) continue;
+        e->sentences++;
+        Tokenizer::words(std::string_view(e->text).substr(at), toks);
+        tallyWords(toks, e->words, e->syllables);
+    }
+    cache_->sentences.put(key, e);
+    return e;
+}
+
+std::string Simplifier::rejoin(const std::vector<std::string>& parts) const {
+    size_t need = 0;
+    for (auto& p : parts) need += p.size() + kPartOverhead;
+
+    std::string out;
+    out.reserve(need);
+    for (auto& p : parts) appendPart(out, p);
+    return out;
+}
+
+// arena is optional. when given, every intermediate (token spans,
+// rewritten parts, stage strings) is allocated from it and nothing is
+// handed back until the caller releases it. not thread safe, like any
+// monotonic_buffer_resource, so with setThreads > 1 each chunk of
+// sentences gets its own arena and the caller's is only used for the
+// per-document bookkeeping
+SimplifiedArticle Simplifier::run(const std::string& text, std::pmr::memory_resource* arena) const {
+    const SentenceRewriter* rw = &rewriter_;
+    SimplifiedArticle out;
+    runImpl(text, &rw, 1, false, arena, &out, nullptr);
+    return out;
+}
+
+// the rewriter a stream or async job goes through for all its sentences:
+// rewriter_ itself, or with a live vocabulary one copy of it over the
+// version that was current at bind(), which stays alive with this
+struct Simplifier::Binding {
+    std::shared_ptr<const LiveVersion> version;
+    std::optional<SentenceRewriter> bound;
+    const SentenceRewriter* rw;
+};
+
+std::shared_ptr<const Simplifier::Binding> Simplifier::bind() const {
+    auto b = std::make_shared<Binding>();
+    b->rw = &rewriter_;
+    if (live_) {
+        b->version = live_->snapshot();
+        b->rw = &b->bound.emplace(rewriter_.withVocabulary(*b->version->at[(int)rewriter_.level()]));
+    }
+    return b;
+}
+
+// rewrites one sentence and appends it to out exactly as run() would have
+// it in the simplified text. with a live vocabulary this pins and binds
+// for the one call, so anything doing a run of sentences should bind()
+// once and use the overload below
+void Simplifier::simplifySentence(std::string_view sentence, std::string& out,
+                                  std::pmr::memory_resource* arena) const {
+    const SentenceRewriter* given = &rewriter_;
+    BoundRewriters b(live_.get(), &given, 1);
+    rewriteSentence(*b.rws[0], sentence, out, arena);
+}
+
+void Simplifier::simplifySentence(const Binding& b, std::string_view sentence, std::string& out,
+                                  std::pmr::memory_resource* arena) const {
+    rewriteSentence(*b.rw, sentence, out, arena);
+}
+
+void Simplifier::rewriteSentence(const SentenceRewriter& rw, std::string_view sentence,
+                                 std::string& out, std::pmr::memory_resource* arena) const {
+    auto mr = arena ? arena : std::pmr::get_default_resource();
+    size_t at = out.size();
+    if (cache_) {
+        out += rewriteCached(rw, sentence, mr)->text;
+    } else {
+        auto parts = rw.rewrite(sentence, mr);
+        StageTimer timer(kStageRejoin);
+        for (auto& p : parts) appendPart(out, p);
+        timer.lap(kStageRejoin);
+    }
+    if (statsOn()) {
+        auto& st = localStats();
+        bump(st.sentences, 1);
+        bump(st.bytesIn, sentence.size());
+        bump(st.bytesOut, out.size() - at);
+    }
+}
+
+// run() into an AlignedArticle: no copy of text, and each output
+// sentence mapped back to its source sentence. text has to outlive the
+// result. not served from the cache, which doesn't keep part boundaries
+AlignedArticle Simplifier::runAligned(std::string_view text, std::pmr::memory_resource* arena) const {
+    if (text.size() > UINT32_MAX) throw std::runtime_error("text too large for aligned output");
+    const SentenceRewriter* rw = &rewriter_;
+    SimplifiedArticle out;
+    AlignedArticle a;
+    runImpl(text, &rw, 1, false, arena, &out, &a);
+    // the output can outgrow the text, and its offsets were cut to 32
+    // bits on the way. it only grows, so checking the end covers them all
+    if (out.simplified.size() > UINT32_MAX) throw std::runtime_error("output too large for aligned output");
+    a.original   = text;
+    a.simplified = std::move(out.simplified);
+    a.level      = out.level;
+    return a;
+}
+
+// same as run() but also fills in before/after metrics. the counts are
+// taken from the token spans we already have and from the rewritten parts
+// as they come out, so nothing gets parsed a second time. each emitted
+// part counts as one output sentence, which can differ from re-analyzing
+// the output when a part ends in something like "Dr." that the tokenizer
+// wouldn't split on mid-text
+SimplifiedArticle Simplifier::runWithMetrics(const std::string& text,
+                                             std::pmr::memory_resource* arena) const {
+    const SentenceRewriter* rw = &rewriter_;
+    SimplifiedArticle out;
+    runImpl(text, &rw, 1, true, arena, &out, nullptr);
+    return out;
+}
+
+// one result per entry of levels, in that order, from a single pass:
+// the text is split and the "before" counts taken once, and for
+// sentences where A1 doesn't strip anything the word swaps are looked up
+// once for both levels. each result is identical to what a Simplifier at
+// that level (same vocabulary, same settings) would give from run()
+std::vector<SimplifiedArticle> Simplifier::runLevels(const std::string& text,
+                                                     const std::vector<CEFRLevel>& levels,
+                                                     bool withMetrics,
+                                                     std::pmr::memory_resource* arena) const {
+    const SentenceRewriter* rws[kMaxLevels];
+    size_t n = 0;
+    bool want[kMaxLevels] = {};
+    for (auto l : levels) want[(int)l] = true;
+    for (int l = 0; l < kMaxLevels; l++)
+        if (want[l]) rws[n++] = (CEFRLevel)l == lvl_ ? &rewriter_ : &altRewriter_;
+
+    SimplifiedArticle done[kMaxLevels];
+    if (n) runImpl(text, rws, n, withMetrics, arena, done, nullptr);
+
+    // moved out the first time a level is asked for, copied after that.
+    // reserved, so copying from out itself is fine
+    std::vector<SimplifiedArticle> out;
+    out.reserve(levels.size());
+    size_t first[kMaxLevels] = {};
+    bool taken[kMaxLevels] = {};
+    for (size_t i = 0; i < levels.size(); i++) {
+        size_t k = 0;
+        while (rws[k]->level() != levels[i]) k++;
+        if (taken[k]) {
+            out.push_back(out[first[k]]);
+        } else {
+            taken[k] = true;
+            first[k] = i;
+            out.push_back(std::move(done[k]));
+        }
+    }
+    return out;
+}
+
+// fills results[0..n) with text rewritten by rws[0..n), sharing the
+// split, the "before" counts and (for two levels) the word pass
+void Simplifier::runImpl(std::string_view text, const SentenceRewriter* const* given, size_t n,
+                         bool withMetrics, std::pmr::memory_resource* arena,
+                         SimplifiedArticle* results, AlignedArticle* align) const {
+    std::pmr::memory_resource* base = arena ? arena : std::pmr::get_default_resource();
+    BoundRewriters bound(live_.get(), given, n);
+    const SentenceRewriter* const* rws = bound.rws;
+
+    auto countDocument = [&](int sentences) {
+        if (!statsOn()) return;
+        auto& st = localStats();
+        bump(st.documents, 1);
+        bump(st.sentences, sentences);
+        bump(st.bytesIn, text.size());
+        for (size_t k = 0; k < n; k++) bump(st.bytesOut, results[k].simplified.size());
+    };
+
+    // cached sentences don't keep where their parts split, so aligned
+    // output always rewrites
+    std::shared_ptr<RewriteCache> cache = align ? nullptr : cache_;
+
+    uint64_t articleKeys[kMaxLevels] = {};
+    if (cache) {
+        std::shared_ptr<const CachedArticle> hits[kMaxLevels];
+        size_t found = 0;
+        for (size_t k = 0; k < n; k++) {
+            articleKeys[k] = RewriteCache::key(text, rws[k]->configKey());
+            hits[k] = cache->articles.find(articleKeys[k], text);
+            found += hits[k] && (hits[k]->hasMetrics || !withMetrics);
+        }
+        if (found == n) {
+            for (size_t k = 0; k < n; k++) {
+                auto& out = results[k];
+                out.original   = text;
+                out.simplified = hits[k]->simplified;
+                out.level      = rws[k]->level();
+                if (withMetrics) {
+                    out.before = hits[k]->before;
+                    out.after  = hits[k]->after;
+                }
+            }
+            countDocument(0);
+            if (progressCounter_) {
+                progressCounter_->total.store(1, std::memory_order_relaxed);
+                progressCounter_->done.store(1, std::memory_order_relaxed);
+            }
+            if (progressFn_) progressFn_(1, 1);
+            return;
+        }
+    }
+
+    // word spans are only needed for the "before" counts
+    auto tt = Tokenizer::tokenize(text, withMetrics, base);
+    const auto& sentences = tt.sentences;
+    int total = (int)sentences.size();
+
+    // small chunks so uneven sentence lengths still balance out
+    size_t grain = threads_ > 1 ? std::max<size_t>(1, total / (threads_ * 8)) : total;
+    size_t nChunks = grain ? (total + grain - 1) / grain : 0;
+
+    // declared before outs so they outlive the parts allocated from them
+    bool perChunk = arena && threads_ > 1;
+    std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>> chunkArenas(perChunk ? nChunks : 0);
+
+    // one slot per input sentence, so it doesn't matter which thread
+    // fills which one. parts is emplaced rather than assigned so it keeps
+    // the allocator it was built with. with a cache, cached is filled in
+    // instead
+    struct LevelOut {
+        std::optional<RewriteParts> parts;
+        std::shared_ptr<const CachedSentence> cached;
+        int outSent = 0, outWords = 0, outSyll = 0;
+    };
+    struct SentenceOut {
+        LevelOut lv[kMaxLevels];
+        int inSent = 0, inWords = 0, inSyll = 0;
+    };
+    std::pmr::vector<SentenceOut> outs(total, base);
+
+    ProgressCounter localProgress;
+    ProgressCounter& progress = progressCounter_ ? *progressCounter_ : localProgress;
+    progress.total.store(total, std::memory_order_relaxed);
+    progress.done.store(0, std::memory_order_relaxed);
+
+    using Clock = std::chrono::steady_clock;
+    std::mutex progressMu;
+    int reported = 0;
+    Clock::time_point lastReport = Clock::now();
+    // with an interval set, only look at the clock every few sentences
+    const int stride = progressEvery_.count() > 0 ? 16 : 1;
+
+    auto work = [&](size_t begin, size_t end) {
+        std::pmr::memory_resource* mr = base;
+        if (perChunk) {
+            auto& a = chunkArenas[begin / grain];
+            a = std::make_unique<std::pmr::monotonic_buffer_resource>(std::pmr::new_delete_resource());
+            mr = a.get();
+        }
+
+        std::pmr::vector<std::string_view> toks(mr);
+        for (size_t i = begin; i < end; i++) {
+            auto& o = outs[i];
+            if (withMetrics && terminated(sentences[i])) {
+                o.inSent = 1;
+                tallyWords(tt.wordsOf(i), o.inWords, o.inSyll);
+            }
+
+            if (cache) {
+                for (size_t k = 0; k < n; k++) {
+                    auto& lv = o.lv[k];
+                    lv.cached = rewriteCached(*rws[k], sentences[i], mr);
+                    lv.outSent  = lv.cached->sentences;
+                    lv.outWords = lv.cached->words;
+                    lv.outSyll  = lv.cached->syllables;
+                }
+            } else if (n == 2) {
+                auto both = rws[0]->rewritePair(*rws[1], sentences[i], mr);
+                o.lv[0].parts.emplace(std::move(both.first));
+                o.lv[1].parts.emplace(std::move(both.second));
+            } else {
+                o.lv[0].parts.emplace(rws[0]->rewrite(sentences[i], mr));
+            }
+            for (size_t k = 0; k < n && withMetrics; k++) {
+                auto& lv = o.lv[k];
+                if (!lv.parts) continue;
+                for (auto& p : *lv.parts) {
+                    // every non-blank part becomes one sentence of the output
+                    size_t start = partStart(p);
+                    if (start == p.size()) continue;
+                    lv.outSent++;
+                    Tokenizer::words(std::string_view(p).substr(start), toks);
+                    tallyWords(toks, lv.outWords, lv.outSyll);
+                }
+            }
+
+            int d = progress.done.fetch_add(1, std::memory_order_relaxed) + 1;
+            if (progressFn_ && d % stride == 0) {
+                // serialized and never going backwards, whatever thread
+                // we're on. try_lock so a slow callback never stalls the rest
+                std::unique_lock<std::mutex> lk(progressMu, std::try_to_lock);
+                if (lk && d > reported) {
+                    auto now = Clock::now();
+                    if (now - lastReport >= progressEvery_) {
+                        reported = d;
+                        lastReport = now;
+                        progressFn_(d, total);
+                    }
+                }
+            }
+        }
+    };
+
+    parallelFor(total, grain, threads_, work);
+    if (progressFn_ && reported < total) progressFn_(total, total);
+
+    int inSent = 0, inWords = 0, inSyll = 0;
+    for (auto& o : outs) {
+        inSent += o.inSent; inWords += o.inWords; inSyll += o.inSyll;
+    }
+
+    for (size_t k = 0; k < n; k++) {
+        // sized once, then every part is written straight into place
+        size_t need = 0;
+        for (auto& o : outs) {
+            auto& lv = o.lv[k];
+            if (lv.cached) need += lv.cached->text.size();
+            else for (auto& p : *lv.parts) need += p.size() + kPartOverhead;
+        }
+
+        StageTimer timer(kStageRejoin);
+        SimplifiedArticle& out = results[k];
+        out.simplified.reserve(need);
+
+        int outSent = 0, outWords = 0, outSyll = 0;
+        for (size_t i = 0; i < outs.size(); i++) {
+            auto& lv = outs[i].lv[k];
+            outSent += lv.outSent; outWords += lv.outWords; outSyll += lv.outSyll;
+            if (lv.cached) {
+                out.simplified += lv.cached->text;
+            } else if (!align) {
+                for (auto& p : *lv.parts) appendPart(out.simplified, p);
+            } else {
+                // blank parts don't make it into the output, so they get no row
+                for (auto& p : *lv.parts) {
+                    size_t at = out.simplified.size();
+                    appendPart(out.simplified, p);
+                    if (out.simplified.size() == at) continue;
+                    align->outputEnd.push_back((uint32_t)out.simplified.size());
+                    align->sourceOf.push_back((uint32_t)i);
+                }
+                align->sourceEnd.push_back((uint32_t)(sentences[i].data() + sentences[i].size() - text.data()));
+            }
+        }
+        timer.lap(kStageRejoin);
+
+        // aligned output only holds a view of the text
+        if (!align) out.original = text;
+        out.level      = rws[k]->level();
+        if (withMetrics) {
+            out.before = TextAnalyzer::score(inSent, inWords, inSyll);
+            out.after  = TextAnalyzer::score(outSent, outWords, outSyll);
+        }
+
+        if (cache) {
+            auto e = std::make_shared<CachedArticle>();
+            e->source     = text;
+            e->simplified = out.simplified;
+            e->hasMetrics = withMetrics;
+            e->before     = out.before;
+            e->after      = out.after;
+            cache->articles.put(articleKeys[k], std::move(e));
+        }
+    }
+    countDocument(total);
+}
+
+// ============================================================
+//  Batch
+// ============================================================
+
+// whole documents in parallel, one simplifier (and the shared vocabulary)
+// for all of them. results line up with docs
+std::vector<SimplifiedArticle> simplifyBatch(const std::vector<std::string>& docs,
+                                             CEFRLevel lvl, unsigned threads,
+                                             bool withMetrics) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+    Simplifier s(lvl);
+    std::vector<SimplifiedArticle> out(docs.size());
+    parallelFor(docs.size(), 1, threads, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            out[i] = withMetrics ? s.runWithMetrics(docs[i]) : s.run(docs[i]);
+    });
+    return out;
+}
+
+// the same with aligned output, which views docs instead of copying
+// every one. docs has to outlive the results
+std::vector<AlignedArticle> simplifyBatchAligned(const std::vector<std::string>& docs,
+                                                 CEFRLevel lvl, unsigned threads) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+    Simplifier s(lvl);
+    std::vector<AlignedArticle> out(docs.size());
+    parallelFor(docs.size(), 1, threads, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) out[i] = s.runAligned(docs[i]);
+    });
+    return out;
+}
+
+// ============================================================
+//  Streaming
+// ============================================================
+
+// push text in whatever pieces it arrives in, simplified sentences come
+// out of the sink as soon as their terminator has been seen. only the
+// unfinished sentence is buffered. the sink output concatenated is the
+// same as run().simplified, except that a "sentence" running past
+// maxSentence bytes with no terminator is cut at its last whitespace so
+// memory stays bounded
+class SimplifierStream {
+public:
+    using Sink = std::function<void(std::string_view)>;
+
+    SimplifierStream(const Simplifier& s, Sink sink, size_t maxSentence = 1 << 16)
+        : simp_(s), bound_(s.bind()), sink_(std::move(sink)), maxSentence_(maxSentence),
+          scratch_(kScratchSize), arena_(scratch_.data(), scratch_.size()) {}
+
+    void feed(std::string_view chunk) {
+        pending_.append(chunk.data(), chunk.size());
+        std::string_view text = pending_;
+
+        // same boundary rules as Tokenizer, but a terminator at the very
+        // end waits for the next chunk since what follows decides it
+        size_t start = 0;
+        while (true) {
+            size_t resume;
+            size_t end = Tokenizer::nextBoundary(text, start, std::max(start, scan_), false, resume);
+            if (end == std::string_view::npos) {
+                scan_ = resume;
+                break;
+            }
+            emit(text.substr(start, end - start));
+            start = end;
+        }
+
+        if (pending_.size() - start > maxSentence_) {
+            std::string_view rest = text.substr(start);
+            size_t cut = rest.size();
+            while (cut > 0 && !isSpace(rest[cut - 1])) cut--;
+            if (cut == 0) cut = rest.size();
+            emit(rest.substr(0, cut));
+            start += cut;
+        }
+        pending_.erase(0, start);
+        scan_ = scan_ > start ? scan_ - start : 0;
+    }
+
+    // flushes whatever is left: boundaries that were waiting on more
+    // input, then a last unterminated sentence
+    void finish() {
+        std::string_view text = pending_;
+        size_t start = 0;
+        size_t resume;
+        size_t end;
+        while ((end = Tokenizer::nextBoundary(text, start, std::max(start, scan_), true, resume))
+               != std::string_view::npos) {
+            emit(text.substr(start, end - start));
+            start = end;
+        }
+        if (start < text.size()) emit(text.substr(start));
+        pending_.clear();
+        scan_ = 0;
+    }
+
+    size_t sentences() const { return count_; }
+
+private:
+    // intermediates for one sentence come out of arena_, which is reset
+    // after each one. ordinary sentences fit in scratch_ and never touch
+    // the heap
+    void emit(std::string_view sentence) {
+        out_.clear();
+        simp_.simplifySentence(*bound_, sentence, out_, &arena_);
+        arena_.release();
+        count_++;
+        if (!out_.empty()) sink_(out_);
+    }
+
+    static constexpr size_t kScratchSize = 16 << 10;
+
+    const Simplifier& simp_;
+    std::shared_ptr<const Simplifier::Binding> bound_;   // one live version for the whole stream
+    Sink sink_;
+    size_t maxSentence_;
+    std::vector<char> scratch_;
+    std::pmr::monotonic_buffer_resource arena_;
+    std::string pending_;
+    size_t scan_ = 0;          // no boundary in pending_ before this
+    std::string out_;
+    size_t count_ = 0;
+};
+
+// reads `in` to the end in fixed-size blocks, see SimplifierStream.
+// no progress callbacks here since the total isn't known up front
+void Simplifier::runStream(std::istream& in, const std::function<void(std::string_view)>& sink) const {
+    SimplifierStream stream(*this, sink);
+    std::vector<char> buf(1 << 16);
+    while (in) {
+        in.read(buf.data(), (std::streamsize)buf.size());
+        std::streamsize n = in.gcount();
+        if (n <= 0) break;
+        stream.feed(std::string_view(buf.data(), (size_t)n));
+    }
+    stream.finish();
+}
+
+// ============================================================
+//  Async
+// ============================================================
+
+// simplifyAsync hands back a future straight away and does the work as
+// a chain of tasks on the caller's executor, one batch of sentences per
+// task. a task never waits on anything, so the executor can be an event
+// loop's own thread. between batches the job checks for cancellation and
+// its deadline, then yields by posting the next batch rather than
+// looping. the simplifier has to outlive the job
+//
+// an executor may also run the task before it returns ([](auto f) { f(); }).
+// then the next batch waits for the one that posted it to unwind
+// instead of nesting inside it, so the stack stays flat however long
+// the document is
+
+struct AsyncOptions {
+    size_t batch = 64;   // sentences per task
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    // set to true and the job stops before its next batch
+    std::shared_ptr<const std::atomic<bool>> cancel;
+    // runs on the executor right after the future is ready, for loops
+    // that would rather be woken up than poll. if the executor refused a
+    // task it runs on the thread that posted it instead. the future is
+    // set by then, so anything it throws has nowhere to go and is dropped
+    std::function<void()> onReady;
+};
+
+namespace {
+
+// the job this thread is in the middle of posting, and whether the
+// executor ran the task inline meanwhile. see AsyncJob::post
+thread_local const void* tPosting = nullptr;
+thread_local bool tDue = false;
+
+class AsyncJob : public std::enable_shared_from_this<AsyncJob> {
+public:
+    AsyncJob(const Simplifier& s, CEFRLevel lvl, std::string text, AsyncExecutor exec, const AsyncOptions& opts,
+             std::function<void(int, int)> progress, ProgressCounter* counter)
+        : simp_(s), bound_(s.bind()), lvl_(lvl), text_(std::move(text)), exec_(std::move(exec)),
+          opts_(opts), progress_(std::move(progress)), counter_(counter) {}
+
+    std::future<SimplifiedArticle> future() { return done_.get_future(); }
+
+    // an executor that refuses the task fails the job instead. a task the
+    // executor runs inline, before exec_ returns, only marks itself due,
+    // and the outermost post on this thread runs due batches in a loop
+    void post() {
+        auto self = shared_from_this();
+        const void* prev = tPosting;
+        bool prevDue = tDue;
+        tPosting = this;
+        tDue = false;
+        try {
+            exec_([self] {
+                if (tPosting == self.get()) tDue = true;
+                else self->step();
+            });
+        } catch (...) {
+            tDue = false;
+            finish(std::current_exception());
+        }
+        if (prev == this) return;   // the loop below, one level up
+        while (tDue) {
+            tDue = false;
+            step();
+        }
+        tPosting = prev;
+        tDue = prevDue;
+    }
+
+private:
+    void step();
+
+    void finish(std::exception_ptr e) {
+        if (finished_.exchange(true)) return;   // an executor that ran the task and then threw
+        done_.set_exception(e);
+        ready();
+    }
 
-    for (auto& sent : sentences) {
-        std::istringstream ss(sent);
-        std::string tok;
-        int wc = 0;
-        while (ss >> tok) {
-            tok.erase(std::remove_if(tok.begin(), tok.end(),
-                [](char c) { return !std::isalpha(c); }), tok.end());
-            if (tok.empty()) continue;
-            wc++;
-            totalSyllables += countSyllables(tok);
+    void ready() {
+        if (!opts_.onReady) return;
+        try {
+            opts_.onReady();
+        } catch (...) {
         }
-        totalWords += wc;
     }
 
-    m.avgWordsPerSentence = (double)totalWords / sentences.size();
-    m.avgSyllablesPerWord = totalWords > 0 ? (double)totalSyllables / totalWords : 0.0;
-    m.fleschScore = calcFlesch(m.avgWordsPerSentence, m.avgSyllablesPerWord);
+    const Simplifier& simp_;
+    std::shared_ptr<const Simplifier::Binding> bound_;   // one live version for the whole job
+    CEFRLevel lvl_;
+    std::string text_;
+    AsyncExecutor exec_;
+    AsyncOptions opts_;
+    std::function<void(int, int)> progress_;
+    ProgressCounter* counter_;
+    std::promise<SimplifiedArticle> done_;
+    std::atomic<bool> finished_{false};
 
-    // these cutoffs are kind of made up, calibrate later
-    double f = m.fleschScore;
-    if      (f >= 80) m.cefrEstimate = 1;
-    else if (f >= 65) m.cefrEstimate = 2;
-    else if (f >= 50) m.cefrEstimate = 3;
-    else if (f >= 40) m.cefrEstimate = 4;
-    else if (f >= 25) m.cefrEstimate = 5;
-    else              m.cefrEstimate = 6;
+    // only touched by whichever task is running, and there's one at a time
+    std::optional<TokenizedText> tt_;
+    size_t next_ = 0;
+    std::string out_;
+};
 
-    return m;
-}
+void AsyncJob::step() {
+    try {
+        if (opts_.cancel && opts_.cancel->load(std::memory_order_relaxed))
+            throw std::runtime_error("simplification cancelled");
+        if (std::chrono::steady_clock::now() >= opts_.deadline)
+            throw std::runtime_error("simplification deadline passed");
 
-// ============================================================
-//  Vocabulary
-// ============================================================
+        // tokenizing is the first task's job too, so the caller's thread
+        // only pays for setting the job up
+        if (!tt_) {
+            tt_.emplace(Tokenizer::tokenize(text_, false));
+            out_.reserve(text_.size() + text_.size() / 8);
+        }
+        const auto& sentences = tt_->sentences;
+        int total = (int)sentences.size();
 
-Vocabulary::Vocabulary(CEFRLevel lvl) : lvl_(lvl) {
-    if (lvl == CEFRLevel::A1) loadA1();
-    else                      loadA2();
-}
+        // the batch's intermediate strings all go at once at the end of it
+        std::pmr::monotonic_buffer_resource arena;
+        size_t end = std::min(sentences.size(), next_ + std::max<size_t>(1, opts_.batch));
+        for (; next_ < end; next_++) simp_.simplifySentence(*bound_, sentences[next_], out_, &arena);
 
-void Vocabulary::loadA1() {
-    // keeping this small for now
-    wordMap_ = {
-        {"utilize",      "use"},
-        {"commence",     "start"},
-        {"terminate",    "end"},
-        {"residence",    "home"},
-        {"purchase",     "buy"},
-        {"inquire",      "ask"},
-        {"observe",      "see"},
-        {"obtain",       "get"},
-        {"assistance",   "help"},
-        {"demonstrate",  "show"},
-        {"approximately","about"},
-        {"sufficient",   "enough"},
-        {"however",      "but"},
-        {"therefore",    "so"},
-        {"additionally", "also"},
-        {"attempt",      "try"},
-        {"require",      "need"},
-    };
-}
-
-void Vocabulary::loadA2() {
-    loadA1();
-    // A2 can handle a bit more
-    wordMap_["facilitate"] = "help";
-    wordMap_["construct"]  = "build";
-    wordMap_["complete"]   = "finish";
-    wordMap_["numerous"]   = "many";
-    wordMap_["previously"] = "before";
-    // TODO: this needs to be way bigger, maybe pull from Oxford 3000
+        if (counter_) {
+            counter_->total.store(total, std::memory_order_relaxed);
+            counter_->done.store((int)next_, std::memory_order_relaxed);
+        }
+        if (progress_) progress_((int)next_, total);
+        if (next_ < sentences.size()) {
+            post();
+            return;
+        }
+
+        if (statsOn()) bump(localStats().documents, 1);
+        SimplifiedArticle a;
+        tt_.reset();
+        a.original   = std::move(text_);
+        a.simplified = std::move(out_);
+        a.level      = lvl_;
+        if (finished_.exchange(true)) return;
+        done_.set_value(std::move(a));
+    } catch (...) {
+        if (finished_.exchange(true)) return;
+        done_.set_exception(std::current_exception());
+    }
+    ready();
 }
 
-bool Vocabulary::isSimple(const std::string& word) const {
-    std::string lower = word;
-    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
-    return wordMap_.find(lower) == wordMap_.end();
+} // namespace
+
+std::future<SimplifiedArticle> Simplifier::simplifyAsync(std::string text, AsyncExecutor exec) const {
+    return simplifyAsync(std::move(text), std::move(exec), AsyncOptions());
 }
 
-std::string Vocabulary::getSimplerWord(const std::string& word) const {
-    std::string lower = word;
-    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
-    auto it = wordMap_.find(lower);
-    if (it != wordMap_.end()) return it->second;
-    return word;
+// the result is what run() gives: the same text, with before and after
+// left default like run() leaves them (runWithMetrics is the one that
+// scores). progress goes to the same callback and counter as run(), once
+// per batch
+std::future<SimplifiedArticle> Simplifier::simplifyAsync(std::string text, AsyncExecutor exec,
+                                                         const AsyncOptions& opts) const {
+    auto job = std::make_shared<AsyncJob>(*this, lvl_, std::move(text), std::move(exec), opts,
+                                          progressFn_, progressCounter_);
+    auto f = job->future();
+    job->post();
+    return f;
 }
 
 // ============================================================
-//  SentenceRewriter
+//  Benchmarks
 // ============================================================
 
-SentenceRewriter::SentenceRewriter(CEFRLevel lvl, const Vocabulary& v)
-    : lvl_(lvl), vocab_(v) {}
+namespace {
+
+// news-ish filler: lexicon words, asides, long conjunction chains and
+// abbreviations, so every stage has something to do. same seed, same text
+std::string makeCorpus(size_t bytes, uint32_t seed) {
+    static const char* const words[] = {
+        "the", "city", "council", "said", "on", "Tuesday", "that", "a", "new",
+        "plan", "would", "be", "voted", "on", "next", "week", "residents",
+        "have", "complained", "about", "traffic", "for", "years", "Dr.", "Smith",
+        "of", "the", "U.S.", "office", "it", "was", "reported", "by", "officials",
+    };
+    static const char* const joins[] = { "and", "but", "because" };
+    const size_t nWords = sizeof(words) / sizeof(*words);
+
+    uint32_t x = seed ? seed : 1;
+    auto next = [&x] { x ^= x << 13; x ^= x >> 17; x ^= x << 5; return x; };
 
-std::string SentenceRewriter::swapWords(const std::string& s) const {
-    std::istringstream ss(s);
-    std::string out, tok;
-    while (ss >> tok) {
-        std::string punct;
-        while (!tok.empty() && std::ispunct((unsigned char)tok.back())) {
-            punct = tok.back() + punct;
-            tok.pop_back();
+    std::string out;
+    out.reserve(bytes + 256);
+    while (out.size() < bytes) {
+        int n = 6 + next() % 24;
+        for (int i = 0; i < n; i++) {
+            uint32_t r = next() % 100;
+            if (r < 12)      out += kLexicon[next() % kLexiconSize].word;
+            else if (r < 16) out += joins[next() % 3];
+            else if (r < 18) out += "(which was expected)";
+            else             out += words[next() % nWords];
+            out += ' ';
         }
-        out += vocab_.getSimplerWord(tok) + punct + " ";
+        out.back() = (next() % 8) ? '.' : '?';
+        out += (next() % 5) ? " " : "\n\n";
     }
-    if (!out.empty()) out.pop_back();
     return out;
 }
 
-std::vector<std::string> SentenceRewriter::trySplit(const std::string& s) const {
-    // split anything over ~10 words (A1) or ~15 words (A2)
-    // the splitting logic here is pretty dumb right now
-    int limit = (lvl_ == CEFRLevel::A1) ? 10 : 15;
-
-    std::istringstream ss(s);
-    std::string tok;
-    std::vector<std::string> words;
-    while (ss >> tok) words.push_back(tok);
-
-    if ((int)words.size() <= limit)
-        return { s };
-
-    std::vector<std::string> chunks;
-    std::string chunk;
-    int count = 0;
-    for (auto& w : words) {
-        chunk += w + " ";
-        count++;
-        std::string lw = w;
-        std::transform(lw.begin(), lw.end(), lw.begin(), ::tolower);
-        // split on conjunctions when we're past the halfway point
-        if ((lw == "and" || lw == "but" || lw == "because") && count >= limit / 2) {
-            chunks.push_back(chunk);
-            chunk.clear();
-            count = 0;
-        }
-    }
-    if (!chunk.empty()) chunks.push_back(chunk);
-    return chunks;
-}
+} // namespace
 
-std::string SentenceRewriter::stripParens(const std::string& s) const {
-    // only strip for A1, A2 readers can probably handle it
-    if (lvl_ != CEFRLevel::A1) return s;
-    return std::regex_replace(s, std::regex(R"(\([^)]*\))"), "");
-}
+// google-benchmark style: each case runs until it has used up minSeconds
+// and reports the mean. allocations per sentence need a
+// -DSIMPLIFIER_COUNT_ALLOCS build, otherwise that column shows "-"
+class Benchmark {
+public:
+    explicit Benchmark(std::ostream& out, double minSeconds = 0.2)
+        : out_(out), minSeconds_(minSeconds) {}
 
-std::string SentenceRewriter::fixPassive(const std::string& s) const {
-    // TODO: this is a whole thing, skipping for now
-    // "the ball was kicked by john" -> "john kicked the ball"
-    // need to actually think about how to detect this reliably
-    return s;
-}
+    void addCorpus(std::string name, std::string text) {
+        corpora_.push_back({ std::move(name), std::move(text) });
+    }
 
-std::vector<std::string> SentenceRewriter::rewrite(const std::string& sentence) const {
-    std::string s = stripParens(sentence);
-    s = swapWords(s);
-    s = fixPassive(s);  // no-op right now
-    return trySplit(s);
-}
+    // 4 KiB, 64 KiB and 1 MiB of makeCorpus
+    void addSynthetic() {
+        addCorpus("synth-4K", makeCorpus(4 << 10, 1));
+        addCorpus("synth-64K", makeCorpus(64 << 10, 2));
+        addCorpus("synth-1M", makeCorpus(1 << 20, 3));
+    }
 
-// ============================================================
-//  Simplifier
-// ============================================================
+    void run(const std::string& filter = "");
 
-Simplifier::Simplifier(CEFRLevel lvl)
-    : lvl_(lvl), vocab_(lvl), rewriter_(lvl, vocab_), progressFn_(nullptr) {}
+private:
+    struct Corpus {
+        std::string name;
+        std::string text;
+    };
 
-void Simplifier::setProgress(std::function<void(int, int)> fn) {
-    progressFn_ = fn;
-}
+    // fn() is one pass over the whole corpus and returns something so the
+    // work can't be thrown away
+    template <typename Fn>
+    void measure(const std::string& name, const Corpus& c, size_t sentences, Fn fn);
 
-std::vector<std::string> Simplifier::splitSentences(const std::string& text) const {
-    std::vector<std::string> out;
-    std::string cur;
-    for (char c : text) {
-        cur += c;
-        if ((c == '.' || c == '!' || c == '?') && !cur.empty()) {
-            out.push_back(cur);
-            cur.clear();
-        }
-    }
-    if (!cur.empty()) out.push_back(cur);
-    return out;
+    std::ostream& out_;
+    double minSeconds_;
+    std::vector<Corpus> corpora_;
+    size_t sink_ = 0;
+};
+
+template <typename Fn>
+void Benchmark::measure(const std::string& name, const Corpus& c, size_t sentences, Fn fn) {
+    using Clock = std::chrono::steady_clock;
+
+    sink_ += fn();  // warm up caches and the lazily built statics
+    uint64_t allocs0 = allocationCount();
+    uint64_t iters = 0;
+    auto t0 = Clock::now();
+    double secs = 0;
+    do {
+        sink_ += fn();
+        iters++;
+        secs = std::chrono::duration<double>(Clock::now() - t0).count();
+    } while (secs < minSeconds_);
+    uint64_t allocs = allocationCount() - allocs0;
+
+    double perIter = secs / iters;
+    out_ << std::left << std::setw(28) << name << std::setw(11) << c.name << std::right
+         << std::fixed << std::setprecision(1)
+         << std::setw(12) << perIter * 1e6 << " us"
+         << std::setw(10) << c.text.size() / perIter / 1e6 << " MB/s"
+         << std::setw(12) << std::setprecision(0) << sentences / perIter << " sent/s";
+#ifdef SIMPLIFIER_COUNT_ALLOCS
+    out_ << std::setw(10) << std::setprecision(2) << (double)allocs / iters / std::max<size_t>(1, sentences);
+#else
+    (void)allocs;
+    out_ << std::setw(10) << "-";
+#endif
+    out_ << "  allocs/sent\n";
 }
 
-std::string Simplifier::rejoin(const std::vector<std::string>& parts) const {
-    std::string out;
-    for (auto& p : parts) {
-        std::string s = p;
+// filter keeps only the cases whose name or corpus contains it
+void Benchmark::run(const std::string& filter) {
+    for (auto& c : corpora_) {
+        auto want = [&](const std::string& name) {
+            return filter.empty() || name.find(filter) != std::string::npos
+                || c.name.find(filter) != std::string::npos;
+        };
 
-        auto start = s.find_first_not_of(" \t\n");
-        if (start != std::string::npos) s = s.substr(start);
-        if (s.empty()) continue;
+        auto tt = Tokenizer::tokenize(c.text, true);
+        std::vector<std::string_view> sentences(tt.sentences.begin(), tt.sentences.end());
+        size_t n = sentences.size();
 
-        s[0] = std::toupper(s[0]);
+        if (want("analyze"))
+            measure("analyze", c, n, [&] { return (size_t)TextAnalyzer::analyze(c.text).cefrEstimate; });
 
-        if (s.back() != '.' && s.back() != '!' && s.back() != '?')
-            s += '.';
+        if (want("countSyllables"))
+            measure("countSyllables", c, n, [&] {
+                size_t s = 0;
+                for (auto w : tt.words) s += TextAnalyzer::countSyllables(w);
+                return s;
+            });
 
-        out += s + " ";
-    }
-    return out;
-}
+        for (auto lvl : { CEFRLevel::A1, CEFRLevel::A2 }) {
+            const char* tag = lvl == CEFRLevel::A1 ? "/A1" : "/A2";
+            SentenceRewriter rw(lvl, *Vocabulary::shared(lvl));
+            auto mr = std::pmr::get_default_resource();
 
-SimplifiedArticle Simplifier::run(const std::string& text) const {
-    auto sentences = splitSentences(text);
-    int total = (int)sentences.size();
+            auto stage = [&](const char* stageName, auto call) {
+                std::string name = std::string(stageName) + tag;
+                if (!want(name)) return;
+                measure(name, c, n, [&] {
+                    size_t s = 0;
+                    for (auto sent : sentences) s += call(sent);
+                    return s;
+                });
+            };
+            // a stage that changes nothing hands back the input as is
+            auto into = [&](auto fn) {
+                return [&rw, mr, fn](std::string_view s) {
+                    std::pmr::string out(mr);
+                    return (rw.*fn)(s, out) ? out.size() : s.size();
+                };
+            };
+            stage("stripParens", into(&SentenceRewriter::stripParens));
+            stage("swapWords",   into(&SentenceRewriter::swapWords));
+            stage("fixPassive",  into(&SentenceRewriter::fixPassive));
+            stage("trySplit",    [&](std::string_view s) { return rw.trySplit(s, mr).size(); });
 
-    std::vector<std::string> result;
-    for (int i = 0; i < total; i++) {
-        auto parts = rewriter_.rewrite(sentences[i]);
-        for (auto& p : parts) result.push_back(p);
+            std::string name = std::string("Simplifier::run") + tag;
+            if (want(name)) {
+                Simplifier s(lvl);
+                measure(name, c, n, [&] { return s.run(c.text).simplified.size(); });
+            }
+        }
 
-        if (progressFn_) progressFn_(i + 1, total);
+        // compare against run/A1 + run/A2
+        if (want("Simplifier::runLevels/A1+A2")) {
+            Simplifier s(CEFRLevel::A2);
+            std::vector<CEFRLevel> both = { CEFRLevel::A1, CEFRLevel::A2 };
+            measure("Simplifier::runLevels/A1+A2", c, n, [&] { return s.runLevels(c.text, both).size(); });
+        }
     }
-
-    SimplifiedArticle out;
-    out.original   = text;
-    out.simplified = rejoin(result);
-    out.level      = lvl_;
-    return out;
 }
 
 // ============================================================
@@ -323,6 +4604,28 @@ void CLI::printResult(const SimplifiedArticle& r) const {
     std::cout << "\n[simplified - " << lvl << "]\n" << r.simplified << "\n";
 }
 
+// swap the built-in word list for a prebuilt lexicon file. both levels
+// are mapped up front so a bad file fails here and not mid-article
+void CLI::setLexicon(const std::string& path) {
+    lexA2_ = std::make_shared<const Vocabulary>(CEFRLevel::A2, path);
+    lexA1_ = lexA2_->atLevel(CEFRLevel::A1);
+}
+
+std::shared_ptr<const Vocabulary> CLI::vocabFor(CEFRLevel lvl) const {
+    const auto& lex = (lvl == CEFRLevel::A1) ? lexA1_ : lexA2_;
+    return lex ? lex : Vocabulary::shared(lvl);
+}
+
+// stdin -> stdout with no prompts, for piping big dumps through
+void CLI::runStream(CEFRLevel lvl) const {
+    std::ios::sync_with_stdio(false);
+    Simplifier s(lvl, vocabFor(lvl));
+    s.runStream(std::cin, [](std::string_view out) {
+        std::cout.write(out.data(), (std::streamsize)out.size());
+    });
+    std::cout << "\n";
+}
+
 void CLI::run() {
     banner();
 
@@ -335,16 +4638,16 @@ void CLI::run() {
 
         CEFRLevel lvl = pickLevel();
 
-        Simplifier s(lvl);
+        Simplifier s(lvl, vocabFor(lvl));
         s.setProgress([](int done, int total) {
             std::cout << "\r  processing... " << done << "/" << total << std::flush;
         });
 
         std::cout << "\n";
-        auto result = s.run(text);
+        auto result = s.runWithMetrics(text);
 
         std::cout << "\nsimplified metrics:\n";
-        showMetrics(TextAnalyzer::analyze(result.simplified));
+        showMetrics(result.after);
 
         printResult(result);
 
@@ -356,8 +4659,1054 @@ void CLI::run() {
     }
 }
 
-int main() {
+static void usage() {
+    std::cerr << "usage: article_simplifier [--lexicon file.lex] [--stream a1|a2]\n"
+                 "       article_simplifier --compile-lexicon words.tsv file.lex\n"
+                 "       article_simplifier --bench [filter] [--corpus file]...\n"
+                 "       article_simplifier --check [dir] [--record] [--corpus file]...\n"
+                 "       article_simplifier --serve   (one JSON request per line on stdin)\n"
+                 "       article_simplifier --batch a1|a2 [--out dir] file|dir|'dir/*.txt'...\n"
+                 "       --stats prints per-stage counters to stderr on exit\n";
+}
+
+static void printStats(std::ostream& os, const PipelineStats& st) {
+    auto ms = [](uint64_t ns) { return ns / 1e6; };
+    os << std::fixed << std::setprecision(1)
+       << "documents " << st.documents << ", sentences " << st.sentences
+       << ", bytes " << st.bytesIn << " in / " << st.bytesOut << " out\n"
+       << "words replaced " << st.wordsReplaced << ", sentences split " << st.sentencesSplit << "\n"
+       << "ms: strip " << ms(st.stripNs) << ", swap " << ms(st.swapNs)
+       << ", passive " << ms(st.passiveNs) << ", custom " << ms(st.customNs)
+       << ", split " << ms(st.splitNs) << ", rejoin " << ms(st.rejoinNs) << "\n";
+}
+
+static bool parseLevel(const std::string& s, CEFRLevel& lvl) {
+    if (s == "a1" || s == "A1") { lvl = CEFRLevel::A1; return true; }
+    if (s == "a2" || s == "A2") { lvl = CEFRLevel::A2; return true; }
+    return false;
+}
+
+namespace {
+
+// just enough JSON for one request per line: a flat object whose values
+// are strings, numbers, true/false/null. nested values are skipped.
+// throws std::runtime_error on anything malformed
+class JsonLine {
+public:
+    struct Value {
+        bool isString = false;
+        std::string text;   // unescaped for strings, raw token otherwise
+    };
+
+    explicit JsonLine(std::string_view s) : s_(s) {}
+
+    template <typename Fn>
+    void members(Fn fn) {
+        ws();
+        expect('{');
+        ws();
+        if (peek() == '}') { i_++; return; }
+        while (true) {
+            ws();
+            std::string key = str();
+            ws();
+            expect(':');
+            ws();
+            Value v;
+            if (peek() == '"') {
+                v.isString = true;
+                v.text = str();
+            } else {
+                size_t b = i_;
+                skip();
+                v.text.assign(s_.substr(b, i_ - b));
+            }
+            fn(key, v);
+            ws();
+            if (peek() == ',') { i_++; continue; }
+            expect('}');
+            break;
+        }
+        ws();
+        if (i_ != s_.size()) fail("trailing characters");
+    }
+
+private:
+    [[noreturn]] void fail(const char* what) const {
+        throw std::runtime_error(std::string("bad json at ") + std::to_string(i_) + ": " + what);
+    }
+
+    char peek() const { return i_ < s_.size() ? s_[i_] : '\0'; }
+    void ws() { while (i_ < s_.size() && isSpace(s_[i_])) i_++; }
+
+    void expect(char c) {
+        if (peek() != c) fail("unexpected character");
+        i_++;
+    }
+
+    unsigned hex4() {
+        if (i_ + 4 > s_.size()) fail("short \\u escape");
+        unsigned v = 0;
+        for (int k = 0; k < 4; k++) {
+            char c = s_[i_++];
+            v <<= 4;
+            if (c >= '0' && c <= '9')      v |= c - '0';
+            else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+            else fail("bad \\u escape");
+        }
+        return v;
+    }
+
+    static void putUtf8(std::string& out, unsigned cp) {
+        if (cp < 0x80) {
+            out += (char)cp;
+        } else if (cp < 0x800) {
+            out += (char)(0xC0 | cp >> 6);
+            out += (char)(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += (char)(0xE0 | cp >> 12);
+            out += (char)(0x80 | (cp >> 6 & 0x3F));
+            out += (char)(0x80 | (cp & 0x3F));
+        } else {
+            out += (char)(0xF0 | cp >> 18);
+            out += (char)(0x80 | (cp >> 12 & 0x3F));
+            out += (char)(0x80 | (cp >> 6 & 0x3F));
+            out += (char)(0x80 | (cp & 0x3F));
+        }
+    }
+
+    std::string str() {
+        expect('"');
+        std::string out;
+        while (true) {
+            // copy the plain run in one go
+            size_t j = i_;
+            while (j < s_.size() && s_[j] != '"' && s_[j] != '\\') j++;
+            out.append(s_.data() + i_, j - i_);
+            i_ = j;
+            if (i_ >= s_.size()) fail("unterminated string");
+            if (s_[i_++] == '"') return out;
+
+            char e = peek();
+            i_++;
+            switch (e) {
+            case '"': case '\\': case '/': out += e; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                unsigned cp = hex4();
+                if (cp >= 0xD800 && cp < 0xDC00 && s_.substr(i_, 2) == "\\u") {
+                    i_ += 2;
+                    unsigned lo = hex4();
+                    if (lo < 0xDC00 || lo >= 0xE000) fail("bad surrogate pair");
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                }
+                putUtf8(out, cp);
+                break;
+            }
+            default: fail("bad escape");
+            }
+        }
+    }
+
+    // a number, literal, or a whole nested object/array, checked against
+    // the grammar so whatever ends up echoed back is still valid JSON
+    void skip(int depth = 0) {
+        if (depth > 64) fail("nested too deep");
+        char c = peek();
+        if (c == '"') {
+            str();
+        } else if (c == '{' || c == '[') {
+            char close = c == '{' ? '}' : ']';
+            i_++;
+            ws();
+            if (peek() == close) { i_++; return; }
+            while (true) {
+                ws();
+                if (close == '}') {
+                    str();
+                    ws();
+                    expect(':');
+                    ws();
+                }
+                skip(depth + 1);
+                ws();
+                if (peek() == ',') { i_++; continue; }
+                expect(close);
+                break;
+            }
+        } else if (!literal("true") && !literal("false") && !literal("null")) {
+            number();
+        }
+    }
+
+    bool literal(std::string_view w) {
+        if (s_.substr(i_, w.size()) != w) return false;
+        i_ += w.size();
+        return true;
+    }
+
+    void number() {
+        auto digits = [&] {
+            size_t b = i_;
+            while (peek() >= '0' && peek() <= '9') i_++;
+            if (i_ == b) fail(b == s_.size() ? "missing value" : "bad value");
+        };
+        if (peek() == '-') i_++;
+        if (peek() == '0') i_++;
+        else digits();
+        if (peek() == '.') {
+            i_++;
+            digits();
+        }
+        if (peek() == 'e' || peek() == 'E') {
+            i_++;
+            if (peek() == '+' || peek() == '-') i_++;
+            digits();
+        }
+    }
+
+    std::string_view s_;
+    size_t i_ = 0;
+};
+
+// bytes that aren't UTF-8 would make the whole line unparseable for the
+// client, so those go out as U+FFFD. checked up front since it's rare
+void appendJsonString(std::string& out, std::string_view s) {
+    bool valid = validUtf8(s);
+    out += '"';
+    for (size_t i = 0; i < s.size(); i++) {
+        char c = s[i];
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if ((unsigned char)c < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", (unsigned)(unsigned char)c);
+                out += buf;
+            } else if (!valid && (unsigned char)c >= 0x80) {
+                size_t len;
+                decodeAt(s, i, len);
+                if (len == 1) out += "\\ufffd";
+                else out.append(s.data() + i, len);
+                i += len - 1;
+            } else {
+                out += c;
+            }
+        }
+    }
+    out += '"';
+}
+
+void appendJsonMetrics(std::string& out, const TextAnalyzer::Metrics& m) {
+    auto num = [&](const char* key, double v) {
+        out += '"';
+        out += key;
+        out += "\":";
+        if (!std::isfinite(v)) { out += "null"; return; }
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.4g", v);
+        out += buf;
+    };
+    out += '{';
+    num("fleschScore", m.fleschScore);               out += ',';
+    num("avgWordsPerSentence", m.avgWordsPerSentence); out += ',';
+    num("avgSyllablesPerWord", m.avgSyllablesPerWord); out += ',';
+    num("cefrEstimate", m.cefrEstimate);
+    out += '}';
+}
+
+} // namespace
+
+// long-running mode: one JSON request per line on in, one JSON response
+// per line on out.
+//   {"id": 7, "text": "...", "level": "a1", "metrics": true}
+// id is optional and echoed back as given, level defaults to a2, metrics
+// to true. requests run concurrently on the shared pool, so responses
+// come back in completion order, not request order. a request that
+// can't be parsed gets {"id": ..., "error": "..."} and the rest carry on.
+// the vocabularies, simplifiers and a result cache stay warm for the
+// whole session.
+//   {"id": 8, "reload": "lexicon.bin"}
+// maps a new lexicon file and switches both levels to it, answering
+// {"id": 8, "generation": n}. requests already running finish on the
+// old one. a file that won't load leaves the current lexicon in place
+void CLI::serve(std::istream& in, std::ostream& out) const {
+    auto cache = std::make_shared<RewriteCache>();
+    auto live = std::make_shared<LiveVocabulary>(vocabFor(CEFRLevel::A2));
+    Simplifier a1(CEFRLevel::A1, live);
+    Simplifier a2(CEFRLevel::A2, live);
+    a1.setCache(cache);
+    a2.setCache(cache);
+
+    // bounded so a fast producer can't queue the whole input in memory
+    const size_t maxInFlight = 2 * ThreadPool::shared().size();
+    std::mutex mu, outMu;
+    std::condition_variable cv;
+    size_t inFlight = 0;
+
+    auto handle = [&](const std::string& line) {
+        std::string id = "null";
+        std::string resp;
+        try {
+            std::string text, level = "a2", reload;
+            bool haveText = false, haveReload = false, metrics = true;
+            JsonLine(line).members([&](const std::string& key, const JsonLine::Value& v) {
+                if (key == "id") {
+                    id.clear();
+                    if (v.isString) appendJsonString(id, v.text);
+                    else id = v.text;
+                } else if (key == "text" && v.isString) {
+                    text = v.text;
+                    haveText = true;
+                } else if (key == "level" && v.isString) {
+                    level = v.text;
+                } else if (key == "metrics") {
+                    if (v.isString || (v.text != "true" && v.text != "false"))
+                        throw std::runtime_error("metrics must be true or false");
+                    metrics = v.text == "true";
+                } else if (key == "reload" && v.isString) {
+                    reload = v.text;
+                    haveReload = true;
+                }
+            });
+            if (haveReload) {
+                uint64_t gen = live->publish(std::make_shared<const Vocabulary>(CEFRLevel::A2, reload));
+                resp = "{\"id\":" + id + ",\"generation\":" + std::to_string(gen) + '}';
+            } else {
+                CEFRLevel lvl = CEFRLevel::A2;
+                if (!haveText) throw std::runtime_error("missing \"text\"");
+                if (!parseLevel(level, lvl)) throw std::runtime_error("level must be a1 or a2");
+
+                const Simplifier& s = lvl == CEFRLevel::A1 ? a1 : a2;
+                auto r = metrics ? s.runWithMetrics(text) : s.run(text);
+
+                resp.reserve(r.simplified.size() + 256);
+                resp += "{\"id\":" + id + ",\"level\":\"" + (lvl == CEFRLevel::A1 ? "A1" : "A2") + "\",\"simplified\":";
+                appendJsonString(resp, r.simplified);
+                if (metrics) {
+                    resp += ",\"before\":";
+                    appendJsonMetrics(resp, r.before);
+                    resp += ",\"after\":";
+                    appendJsonMetrics(resp, r.after);
+                }
+                resp += '}';
+            }
+        } catch (const std::exception& e) {
+            resp = "{\"id\":" + id + ",\"error\":";
+            appendJsonString(resp, e.what());
+            resp += '}';
+        }
+        resp += '\n';
+
+        std::lock_guard<std::mutex> lk(outMu);
+        out.write(resp.data(), (std::streamsize)resp.size());
+        out.flush();
+    };
+
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+        std::unique_lock<std::mutex> lk(mu);
+        cv.wait(lk, [&] { return inFlight < maxInFlight; });
+        inFlight++;
+        lk.unlock();
+
+        ThreadPool::shared().submit([&, line = std::move(line)] {
+            handle(line);
+            // notified under the lock: once inFlight hits 0 the caller may
+            // return and take cv with it
+            std::lock_guard<std::mutex> lk(mu);
+            inFlight--;
+            cv.notify_all();
+        });
+        line = std::string();
+    }
+
+    std::unique_lock<std::mutex> lk(mu);
+    cv.wait(lk, [&] { return inFlight == 0; });
+}
+
+namespace {
+
+// whole file in one read, sized from fstat up front
+bool readFile(const std::string& path, std::string& out) {
+#if defined(_WIN32)
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    in.seekg(0, std::ios::end);
+    out.resize((size_t)in.tellg());
+    in.seekg(0);
+    in.read(&out[0], (std::streamsize)out.size());
+    return (bool)in;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    out.resize((size_t)st.st_size);
+    size_t got = 0;
+    while (got < out.size()) {
+        ssize_t n = ::read(fd, &out[got], out.size() - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            ::close(fd);
+            return false;
+        }
+        if (n == 0) break;
+        got += (size_t)n;
+    }
+    ::close(fd);
+    out.resize(got);  // the file may have shrunk under us
+    return true;
+#endif
+}
+
+bool writeFile(const std::string& path, std::string_view data) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), (std::streamsize)data.size());
+    return (bool)out;
+}
+
+// * and ? only, for the last path component
+bool globMatch(std::string_view pat, std::string_view name) {
+    size_t p = 0, n = 0, star = std::string_view::npos, mark = 0;
+    while (n < name.size()) {
+        if (p < pat.size() && (pat[p] == '?' || pat[p] == name[n])) {
+            p++;
+            n++;
+        } else if (p < pat.size() && pat[p] == '*') {
+            star = p++;
+            mark = n;
+        } else if (star != std::string_view::npos) {
+            p = star + 1;
+            n = ++mark;
+        } else {
+            return false;
+        }
+    }
+    while (p < pat.size() && pat[p] == '*') p++;
+    return p == pat.size();
+}
+
+} // namespace
+
+// non-interactive: every input (a file, a directory walked recursively,
+// or a dir/*.txt style pattern) is simplified at lvl on all cores. the
+// output goes next to the input as <name>.a1 / <name>.a2, or under
+// outDir keeping the path relative to the argument it came from. files
+// already carrying one of those suffixes are skipped when walking so a
+// rerun doesn't feed on its own output. returns the number of failures
+int CLI::runBatch(CEFRLevel lvl, const std::vector<std::string>& inputs,
+                  const std::string& outDir) const {
+    namespace fs = std::filesystem;
+    const std::string suffix = lvl == CEFRLevel::A1 ? ".a1" : ".a2";
+
+    struct Job {
+        std::string in, out;
+    };
+    std::vector<Job> jobs;
+    int failures = 0;
+
+    auto add = [&](const fs::path& file, const fs::path& root) {
+        std::string out;
+        if (outDir.empty()) {
+            out = file.string() + suffix;
+        } else {
+            fs::path rel = root.empty() ? file.filename() : file.lexically_relative(root);
+            out = (fs::path(outDir) / rel).string() + suffix;
+        }
+        jobs.push_back({ file.string(), std::move(out) });
+    };
+    auto isOutput = [](const fs::path& p) {
+        auto ext = p.extension();
+        return ext == ".a1" || ext == ".a2";
+    };
+
+    for (auto& arg : inputs) {
+        std::error_code ec;
+        fs::path p(arg);
+        if (arg.find_first_of("*?") != std::string::npos) {
+            fs::path dir = p.has_parent_path() ? p.parent_path() : fs::path(".");
+            std::string pat = p.filename().string();
+            for (auto it = fs::directory_iterator(dir, ec); !ec && it != fs::directory_iterator(); it.increment(ec))
+                if (it->is_regular_file(ec) && !isOutput(it->path())
+                    && globMatch(pat, it->path().filename().string()))
+                    add(it->path(), dir);
+        } else if (fs::is_directory(p, ec)) {
+            for (auto it = fs::recursive_directory_iterator(p, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec))
+                if (it->is_regular_file(ec) && !isOutput(it->path()))
+                    add(it->path(), p);
+        } else if (fs::is_regular_file(p, ec)) {
+            add(p, fs::path());
+        } else {
+            std::cerr << "no such file: " << arg << "\n";
+            failures++;
+            continue;
+        }
+        if (ec) {
+            std::cerr << arg << ": " << ec.message() << "\n";
+            failures++;
+        }
+    }
+
+    // directories are made up front, once each, instead of per file
+    if (!outDir.empty()) {
+        std::vector<std::string> dirs;
+        for (auto& j : jobs) dirs.push_back(fs::path(j.out).parent_path().string());
+        std::sort(dirs.begin(), dirs.end());
+        dirs.erase(std::unique(dirs.begin(), dirs.end()), dirs.end());
+        for (auto& d : dirs) {
+            std::error_code ec;
+            if (!d.empty()) fs::create_directories(d, ec);
+        }
+    }
+
+    // boilerplate repeats across files far more than within one
+    auto cache = std::make_shared<RewriteCache>();
+    Simplifier s(lvl, vocabFor(lvl));
+    s.setCache(cache);
+
+    struct FileResult {
+        bool ok = false;
+        size_t bytesIn = 0, bytesOut = 0;
+        TextAnalyzer::Metrics before, after;
+    };
+    std::vector<FileResult> results(jobs.size());
+    std::mutex errMu;
+
+    auto t0 = std::chrono::steady_clock::now();
+    // files are the unit of work, each one rewritten on a single thread
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    parallelFor(jobs.size(), 4, threads, [&](size_t begin, size_t end) {
+        std::string text;  // reused across this chunk's files
+        for (size_t i = begin; i < end; i++) {
+            auto& r = results[i];
+            const char* err = nullptr;
+            if (!readFile(jobs[i].in, text)) {
+                err = "can't read ";
+            } else {
+                auto out = s.runWithMetrics(text);
+                if (!writeFile(jobs[i].out, out.simplified)) {
+                    err = "can't write output for ";
+                } else {
+                    r.ok = true;
+                    r.bytesIn = text.size();
+                    r.bytesOut = out.simplified.size();
+                    r.before = out.before;
+                    r.after = out.after;
+                }
+            }
+            if (err) {
+                std::lock_guard<std::mutex> lk(errMu);
+                std::cerr << err << jobs[i].in << "\n";
+            }
+        }
+    });
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    // per-file scores averaged, weighted by size so one long feature
+    // counts for more than a stack of one-liners
+    size_t ok = 0, bytesIn = 0, bytesOut = 0;
+    double fleschIn = 0, fleschOut = 0, weight = 0;
+    for (auto& r : results) {
+        if (!r.ok) {
+            failures++;
+            continue;
+        }
+        ok++;
+        bytesIn += r.bytesIn;
+        bytesOut += r.bytesOut;
+        if (std::isfinite(r.before.fleschScore) && std::isfinite(r.after.fleschScore)) {
+            fleschIn += r.before.fleschScore * r.bytesIn;
+            fleschOut += r.after.fleschScore * r.bytesIn;
+            weight += r.bytesIn;
+        }
+    }
+
+    auto cs = cache->stats();
+    uint64_t lookups = cs.sentenceHits + cs.sentenceMisses;
+    std::cerr << std::fixed << std::setprecision(1)
+              << ok << " files simplified, " << failures << " failed, "
+              << bytesIn / 1e6 << " MB in / " << bytesOut / 1e6 << " MB out in " << secs << " s ("
+              << (secs > 0 ? bytesIn / 1e6 / secs : 0.0) << " MB/s)\n";
+    if (weight > 0)
+        std::cerr << "flesch " << fleschIn / weight << " -> " << fleschOut / weight << "\n";
+    if (lookups)
+        std::cerr << "sentence cache hits " << 100.0 * cs.sentenceHits / lookups << "%\n";
+    return failures;
+}
+
+// ============================================================
+//  Regression checks
+// ============================================================
+
+// --check: analyze and run at both levels over a fixed corpus, with the
+// output compared against golden files and held to budgets for
+// allocations per sentence, throughput and peak RSS. --record writes the
+// goldens and budgets instead. budgets are recorded with headroom, since
+// timings are noisy and the box that checks is rarely the one that
+// recorded, and they're plain text so a change that knowingly costs
+// something can loosen one by hand. a case with no budget fails, the
+// same as one with no golden. allocations are only counted (and their
+// budgets only checked) in a -DSIMPLIFIER_COUNT_ALLOCS build; recording
+// in any other build keeps the allocation budgets already on file, and a
+// counting build fails the ones that were never recorded. testdata/ has
+// the synthetic corpora's goldens and budgets, and is where --check
+// looks by default
+
+namespace {
+
+// high water mark of the whole process, in KiB. 0 where we can't tell
+size_t peakRssKb() {
+#if defined(_WIN32)
+    return 0;
+#else
+    struct rusage ru;
+    if (::getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#if defined(__APPLE__)
+    return (size_t)ru.ru_maxrss / 1024;
+#else
+    return (size_t)ru.ru_maxrss;
+#endif
+#endif
+}
+
+std::string formatMetrics(const TextAnalyzer::Metrics& m) {
+    char buf[160];
+    std::snprintf(buf, sizeof(buf), "wps %.6f spw %.6f flesch %.6f cefr %d\n",
+                  m.avgWordsPerSentence, m.avgSyllablesPerWord, m.fleschScore, m.cefrEstimate);
+    return buf;
+}
+
+// sentences the synthetic corpora don't reach, kept in the goldens so a
+// change to how they come out is seen. passives whose agent goes on past
+// its head noun have to come out as they went in
+constexpr std::string_view kCheckCases[] = {
+    "The ball was kicked by John.",
+    "The house was built by my father, and it still stands.",
+    "The house was built by my father and his friend.",
+    "The prize was won by John or Mary.",
+    "The city was taken by the army of Rome.",
+    "The book was written by the man who lived next door.",
+    "The bridge was designed by engineers which surprised many.",
+    "It was done by me and by him.",
+    "It was reported by officials that the plan would fail.",
+};
+
+} // namespace
+
+class RegressionCheck {
+public:
+    // dir holds <corpus>.<case>.golden files and budgets.txt
+    explicit RegressionCheck(std::string dir, double minSeconds = 0.2)
+        : dir_(std::move(dir)), minSeconds_(minSeconds) {}
+
+    void addCorpus(std::string name, std::string text) {
+        corpora_.push_back({ std::move(name), std::move(text) });
+    }
+
+    // the 4 KiB and 64 KiB synthetic corpora from the benchmarks, and
+    // the hand-written cases below
+    void addSynthetic() {
+        addCorpus("synth-4K", makeCorpus(4 << 10, 1));
+        addCorpus("synth-64K", makeCorpus(64 << 10, 2));
+        std::string cases;
+        for (auto c : kCheckCases) cases.append(c).append(" ");
+        addCorpus("cases", std::move(cases));
+    }
+
+    // one JSON object to out, failures to err as they're found. true if
+    // everything passed
+    bool run(std::ostream& out, std::ostream& err, bool record);
+
+private:
+    struct Corpus {
+        std::string name;
+        std::string text;
+    };
+
+    struct Result {
+        std::string name;
+        const Corpus* corpus = nullptr;
+        size_t sentences = 0;
+        double mbps = 0;
+        double allocsPerSent = -1;  // -1 when not counted
+        std::string output;         // from the first pass
+        std::string golden;         // ok, recorded, missing or differs at byte n
+        std::vector<std::string> failures;
+    };
+
+    // fn() is one pass over the whole corpus and returns its output
+    template <typename Fn>
+    Result measure(const std::string& name, const Corpus& c, size_t sentences, Fn fn);
+
+    void compareGolden(Result& r, const std::string& got, bool record);
+    void checkBudget(Result& r, const std::string& metric, double got, bool atMost, double headroom,
+                     bool record);
+    bool loadBudgets();
+    bool saveBudgets() const;
+
+    std::string dir_;
+    double minSeconds_;
+    std::vector<Corpus> corpora_;
+    std::unordered_map<std::string, double> budgets_;  // "<case>/<corpus> <metric>" -> limit
+    size_t sink_ = 0;
+};
+
+template <typename Fn>
+RegressionCheck::Result RegressionCheck::measure(const std::string& name, const Corpus& c,
+                                                 size_t sentences, Fn fn) {
+    using Clock = std::chrono::steady_clock;
+
+    Result r;
+    r.name = name;
+    r.corpus = &c;
+    r.sentences = sentences;
+
+    r.output = fn();  // warms up the statics too
+    uint64_t allocs0 = allocationCount();
+    uint64_t iters = 0;
+    auto t0 = Clock::now();
+    double secs = 0;
+    // the best of several slices rather than the mean, so a busy box
+    // doesn't fail the floor
+    double best = 1e30;
+    do {
+        auto s0 = Clock::now();
+        uint64_t k = 0;
+        double slice = 0;
+        do {
+            sink_ += fn().size();
+            k++;
+            slice = std::chrono::duration<double>(Clock::now() - s0).count();
+        } while (slice < minSeconds_ / 8);
+        best = std::min(best, slice / k);
+        iters += k;
+        secs = std::chrono::duration<double>(Clock::now() - t0).count();
+    } while (secs < minSeconds_);
+    uint64_t allocs = allocationCount() - allocs0;
+
+    r.mbps = c.text.size() / best / 1e6;
+#ifdef SIMPLIFIER_COUNT_ALLOCS
+    r.allocsPerSent = (double)allocs / iters / std::max<size_t>(1, sentences);
+#else
+    (void)allocs;
+#endif
+    return r;
+}
+
+void RegressionCheck::compareGolden(Result& r, const std::string& got, bool record) {
+    std::string path = dir_ + "/" + r.corpus->name + "." + r.name + ".golden";
+    if (record) {
+        if (!writeFile(path, got)) r.failures.push_back("can't write " + path);
+        r.golden = "recorded";
+        return;
+    }
+    std::string want;
+    if (!readFile(path, want)) {
+        r.golden = "missing";
+        r.failures.push_back("no golden output in " + path);
+        return;
+    }
+    if (want == got) {
+        r.golden = "ok";
+        return;
+    }
+    size_t n = std::min(want.size(), got.size());
+    size_t at = std::mismatch(want.begin(), want.begin() + n, got.begin()).first - want.begin();
+    r.golden = "differs at byte " + std::to_string(at);
+    r.failures.push_back("output " + r.golden + " of " + path);
+}
+
+// atMost for costs (allocations, memory), otherwise got is a floor
+// (throughput). recording sets the limit to got scaled by headroom
+void RegressionCheck::checkBudget(Result& r, const std::string& metric, double got, bool atMost,
+                                  double headroom, bool record) {
+    std::string key = (r.corpus ? r.name + "/" + r.corpus->name : r.name) + " " + metric;
+    if (record) {
+        // rounded away from got, so the saved limit can't fail a rerun
+        double limit = got * headroom;
+        budgets_[key] = atMost ? std::ceil(limit * 100 + 1) / 100 : std::floor(limit * 100) / 100;
+        return;
+    }
+    auto it = budgets_.find(key);
+    if (it == budgets_.end()) {
+        r.failures.push_back("no budget for " + key);
+        return;
+    }
+    if (atMost ? got <= it->second : got >= it->second) return;
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(2) << metric << " " << got
+       << (atMost ? " over budget " : " under budget ") << it->second;
+    r.failures.push_back(os.str());
+}
+
+// "<case>/<corpus> <metric> <limit>" per line ("process" for the whole
+// run), # starts a comment
+bool RegressionCheck::loadBudgets() {
+    std::ifstream in(dir_ + "/budgets.txt");
+    if (!in) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ls(line);
+        std::string name, metric;
+        double limit;
+        if (!(ls >> name >> metric >> limit))
+            throw std::runtime_error("bad budget line: " + line);
+        budgets_[name + " " + metric] = limit;
+    }
+    return true;
+}
+
+bool RegressionCheck::saveBudgets() const {
+    std::ostringstream os;
+    os << "# written by --check --record, edit by hand to loosen\n" << std::fixed << std::setprecision(2);
+    std::vector<std::pair<std::string, double>> sorted(budgets_.begin(), budgets_.end());
+    std::sort(sorted.begin(), sorted.end());
+    for (auto& [key, limit] : sorted) os << key << " " << limit << "\n";
+    return writeFile(dir_ + "/budgets.txt", os.str());
+}
+
+bool RegressionCheck::run(std::ostream& out, std::ostream& err, bool record) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> failures;  // the ones that aren't about one case
+
+    if (record) {
+        // re-recording only replaces what this build measures
+        std::error_code ec;
+        fs::create_directories(dir_, ec);
+        loadBudgets();
+    } else if (!loadBudgets()) {
+        failures.push_back("no budgets in " + dir_ + "/budgets.txt");
+    }
+
+#ifdef SIMPLIFIER_COUNT_ALLOCS
+    const bool counted = true;
+#else
+    const bool counted = false;
+#endif
+    std::vector<Result> results;
+    for (auto& c : corpora_) {
+        size_t n = Tokenizer::tokenize(c.text, false).sentences.size();
+        results.push_back(measure("analyze", c, n, [&] {
+            return formatMetrics(TextAnalyzer::analyze(c.text));
+        }));
+        for (auto lvl : { CEFRLevel::A1, CEFRLevel::A2 }) {
+            Simplifier s(lvl);
+            results.push_back(measure(lvl == CEFRLevel::A1 ? "run-A1" : "run-A2", c, n, [&] {
+                return s.run(c.text).simplified;
+            }));
+        }
+    }
+
+    for (auto& r : results) {
+        compareGolden(r, r.output, record);
+        if (counted) checkBudget(r, "allocs_per_sent", r.allocsPerSent, true, 1.1, record);
+        checkBudget(r, "mb_per_s", r.mbps, false, 0.5, record);
+    }
+
+    // one figure for the whole run, the corpora share the process
+    size_t rss = peakRssKb();
+    if (rss) {
+        Result whole;
+        whole.name = "process";
+        checkBudget(whole, "peak_rss_kb", (double)rss, true, 1.25, record);
+        failures.insert(failures.end(), whole.failures.begin(), whole.failures.end());
+    }
+
+    if (record && !saveBudgets()) failures.push_back("can't write " + dir_ + "/budgets.txt");
+
+    bool passed = failures.empty();
+    for (auto& f : failures) err << "check: " << f << "\n";
+    for (auto& r : results) {
+        for (auto& f : r.failures) err << "check: " << r.name << "/" << r.corpus->name << ": " << f << "\n";
+        passed = passed && r.failures.empty();
+    }
+
+    auto num = [](double v, const char* fmt) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), fmt, v);
+        return std::string(buf);
+    };
+    auto strings = [](std::string& s, const std::vector<std::string>& v) {
+        s += '[';
+        for (size_t i = 0; i < v.size(); i++) {
+            if (i) s += ',';
+            appendJsonString(s, v[i]);
+        }
+        s += ']';
+    };
+
+    std::string json = "{\"passed\":";
+    json += passed ? "true" : "false";
+    json += ",\"recorded\":";
+    json += record ? "true" : "false";
+    json += ",\"allocs_counted\":";
+    json += counted ? "true" : "false";
+    json += ",\"peak_rss_kb\":";
+    json += rss ? std::to_string(rss) : "null";
+    json += ",\"failures\":";
+    strings(json, failures);
+    json += ",\"cases\":[";
+    for (size_t i = 0; i < results.size(); i++) {
+        auto& r = results[i];
+        if (i) json += ',';
+        json += "{\"case\":";
+        appendJsonString(json, r.name);
+        json += ",\"corpus\":";
+        appendJsonString(json, r.corpus->name);
+        json += ",\"bytes\":" + std::to_string(r.corpus->text.size());
+        json += ",\"sentences\":" + std::to_string(r.sentences);
+        json += ",\"mb_per_s\":" + num(r.mbps, "%.2f");
+        json += ",\"allocs_per_sent\":";
+        json += counted ? num(r.allocsPerSent, "%.3f") : "null";
+        json += ",\"golden\":";
+        appendJsonString(json, r.golden);
+        json += ",\"failures\":";
+        strings(json, r.failures);
+        json += '}';
+    }
+    json += "]}\n";
+    out << json;
+    return passed;
+}
+
+// --corpus files, each named after its last path component
+template <typename Target>
+static bool addCorpusFiles(Target& t, const std::vector<std::string>& paths) {
+    for (auto& path : paths) {
+        std::string text;
+        if (!readFile(path, text)) {
+            std::cerr << "can't read " << path << "\n";
+            return false;
+        }
+        auto slash = path.find_last_of("/\\");
+        t.addCorpus(slash == std::string::npos ? path : path.substr(slash + 1), std::move(text));
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
     CLI cli;
+    bool stream = false;
+    CEFRLevel streamLvl = CEFRLevel::A2;
+    bool bench = false;
+    bool stats = false;
+    bool serve = false;
+    std::string benchFilter;
+    std::string checkDir;
+    bool record = false;
+    std::vector<std::string> corpora;
+    bool batch = false;
+    CEFRLevel batchLvl = CEFRLevel::A2;
+    std::string outDir;
+    std::vector<std::string> inputs;
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string a = argv[i];
+            if (a == "--compile-lexicon" && i + 2 < argc) {
+                size_t n = compileLexicon(argv[i + 1], argv[i + 2]);
+                std::cout << "wrote " << n << " entries to " << argv[i + 2] << "\n";
+                return 0;
+            } else if (a == "--lexicon" && i + 1 < argc) {
+                cli.setLexicon(argv[++i]);
+            } else if (a == "--stream" && i + 1 < argc && parseLevel(argv[i + 1], streamLvl)) {
+                stream = true;
+                i++;
+            } else if (a == "--bench") {
+                bench = true;
+                if (i + 1 < argc && argv[i + 1][0] != '-') benchFilter = argv[++i];
+            } else if (a == "--check") {
+                checkDir = "testdata";
+                if (i + 1 < argc && argv[i + 1][0] != '-') checkDir = argv[++i];
+            } else if (a == "--record") {
+                record = true;
+            } else if (a == "--serve") {
+                serve = true;
+            } else if (a == "--stats") {
+                stats = true;
+                enablePipelineStats(true);
+            } else if (a == "--corpus" && i + 1 < argc) {
+                corpora.push_back(argv[++i]);
+            } else if (a == "--batch" && i + 1 < argc && parseLevel(argv[i + 1], batchLvl)) {
+                batch = true;
+                i++;
+            } else if (a == "--out" && i + 1 < argc) {
+                outDir = argv[++i];
+            } else if (batch && a.compare(0, 2, "--") != 0) {
+                inputs.push_back(a);
+            } else {
+                usage();
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    if (stream) {
+        cli.runStream(streamLvl);
+        if (stats) printStats(std::cerr, pipelineStats());
+        return 0;
+    }
+
+    if (batch) {
+        if (inputs.empty()) {
+            usage();
+            return 1;
+        }
+        int failures = cli.runBatch(batchLvl, inputs, outDir);
+        if (stats) printStats(std::cerr, pipelineStats());
+        return failures ? 1 : 0;
+    }
+
+    if (serve) {
+        std::ios::sync_with_stdio(false);
+        cli.serve(std::cin, std::cout);
+        if (stats) printStats(std::cerr, pipelineStats());
+        return 0;
+    }
+
+    if (bench) {
+        Benchmark b(std::cout);
+        b.addSynthetic();
+        if (!addCorpusFiles(b, corpora)) return 1;
+        b.run(benchFilter);
+        return 0;
+    }
+
+    if (record && checkDir.empty()) {
+        usage();
+        return 1;
+    }
+
+    if (!checkDir.empty()) {
+        RegressionCheck c(checkDir);
+        c.addSynthetic();
+        if (!addCorpusFiles(c, corpora)) return 1;
+        try {
+            return c.run(std::cout, std::cerr, record) ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+    }
+
     cli.run();
+    if (stats) printStats(std::cerr, pipelineStats());
     return 0;
 }